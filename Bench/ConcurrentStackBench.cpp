@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "../ConcurrentStack.hpp"
+
+/**
+ * @brief Push/pop throughput of a mutex guarded @see Stack against @see ConcurrentStack.
+ *
+ * Every thread does pairs of Push and Pop on one shared stack.
+ * The last column is the share of lock-free operations done through elimination.
+ * Usage: ConcurrentStackBench [operations per thread]
+*/
+
+static const size_t THREAD_COUNTS[] = {1, 2, 4, 8, 16, 32, 64};
+
+static const size_t DEFAULT_BENCH_OPERATIONS = 1000000;
+
+struct _BenchArgs
+{
+    void* stack;
+    pthread_mutex_t* mutex;
+    size_t operations;
+    pthread_barrier_t* start;
+};
+
+static void* _lockedWorker(void* argsPtr)
+{
+    _BenchArgs* args = (_BenchArgs*)argsPtr;
+    Stack<int>* stack = (Stack<int>*)args->stack;
+
+    pthread_barrier_wait(args->start);
+
+    for (size_t i = 0; i < args->operations; i++)
+    {
+        pthread_mutex_lock(args->mutex);
+        Push(stack, (int)i);
+        pthread_mutex_unlock(args->mutex);
+
+        pthread_mutex_lock(args->mutex);
+        Pop(stack);
+        pthread_mutex_unlock(args->mutex);
+    }
+
+    return NULL;
+}
+
+static void* _lockFreeWorker(void* argsPtr)
+{
+    _BenchArgs* args = (_BenchArgs*)argsPtr;
+    ConcurrentStack<int>* stack = (ConcurrentStack<int>*)args->stack;
+
+    pthread_barrier_wait(args->start);
+
+    for (size_t i = 0; i < args->operations; i++)
+    {
+        Push(stack, (int)i);
+        Pop(stack);
+    }
+
+    return NULL;
+}
+
+static double _runBench(void* (*worker)(void*), void* stack, size_t threadsCount, size_t operations)
+{
+    pthread_t* threads = (pthread_t*)calloc(threadsCount, sizeof(pthread_t));
+    _BenchArgs* args = (_BenchArgs*)calloc(threadsCount, sizeof(_BenchArgs));
+
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_barrier_t start = {};
+    pthread_barrier_init(&start, NULL, (unsigned)threadsCount + 1);
+
+    for (size_t i = 0; i < threadsCount; i++)
+    {
+        args[i] = {stack, &mutex, operations, &start};
+        pthread_create(&threads[i], NULL, worker, &args[i]);
+    }
+
+    timespec begin = {}, end = {};
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    pthread_barrier_wait(&start);
+
+    for (size_t i = 0; i < threadsCount; i++)
+        pthread_join(threads[i], NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pthread_barrier_destroy(&start);
+    free(threads);
+    free(args);
+
+    double seconds = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    return (double)(2 * operations * threadsCount) / seconds / 1e6;
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t operations = argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_BENCH_OPERATIONS;
+
+    printf("%8s %16s %16s %12s\n", "threads", "mutex Mops/s", "lock-free Mops/s", "eliminated");
+
+    for (size_t i = 0; i < sizeof(THREAD_COUNTS) / sizeof(*THREAD_COUNTS); i++)
+    {
+        size_t threadsCount = THREAD_COUNTS[i];
+        size_t threadOperations = operations / threadsCount;
+
+        Stack<int>* locked = StackInit(int).value;
+        ConcurrentStack<int>* lockFree = ConcurrentStackInit(int).value;
+
+        if (!locked || !lockFree)
+            return ERROR_NO_MEMORY;
+
+        double lockedSpeed   = _runBench(_lockedWorker,   locked,   threadsCount, threadOperations);
+        double lockFreeSpeed = _runBench(_lockFreeWorker, lockFree, threadsCount, threadOperations);
+
+        double eliminated = 100.0 * (double)(2 * ConcurrentStackGetStats(lockFree).eliminated) /
+                            (double)(2 * threadOperations * threadsCount);
+
+        printf("%8zu %16.2f %16.2f %11.2f%%\n", threadsCount, lockedSpeed, lockFreeSpeed, eliminated);
+
+        StackDestructor(locked);
+        StackDestructor(lockFree);
+    }
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../Utils.hpp"
+#include "../MinMax.hpp"
+
+/**
+ * @brief Throughput of every @see HashBackend the CPU supports on buffers from 16 B to 1 GB.
+ *
+ * Each size is hashed repeatedly over a sliding offset, so small buffers are not
+ * always aligned and the seed changes between calls like it does for stack slots.
+ * Usage: HashBench [max buffer size in MB]
+*/
+
+static const size_t DEFAULT_BENCH_MAX_SIZE_MB = 1024;
+
+static const size_t BENCH_MIN_SIZE = 16;
+
+static const size_t BENCH_SIZE_STEP = 4;
+
+/**
+ * @brief Bytes hashed per buffer size, so every size takes about the same time.
+*/
+static const size_t BENCH_BYTES_PER_SIZE = 1 << 30;
+
+static double _getSeconds()
+{
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static double _benchHash(const unsigned char* buffer, size_t bufferSize, size_t size, unsigned int* sink)
+{
+    size_t calls = BENCH_BYTES_PER_SIZE / size;
+    size_t offsets = min(bufferSize - size + 1, (size_t)64);
+
+    unsigned int hash = 0;
+
+    double begin = _getSeconds();
+
+    for (size_t i = 0; i < calls; i++)
+        hash += CalculateHash(buffer + i % offsets, size, (unsigned int)i);
+
+    double end = _getSeconds();
+
+    *sink += hash;
+
+    return (end - begin) / (double)calls;
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t maxSize = (argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_BENCH_MAX_SIZE_MB) << 20;
+
+    // Room for the sliding offsets
+    size_t bufferSize = maxSize + 64;
+    unsigned char* buffer = (unsigned char*)malloc(bufferSize);
+
+    if (!buffer)
+        return ERROR_NO_MEMORY;
+
+    for (size_t i = 0; i < bufferSize; i++)
+        buffer[i] = (unsigned char)(i * 131 + (i >> 8));
+
+    printf("auto backend = %s\n", HASH_BACKEND_NAMES[GetHashBackend()]);
+    printf("%-10s %12s", "size", "");
+
+    for (int backend = HASH_BACKEND_MURMUR; backend <= HASH_BACKEND_AVX2; backend++)
+        printf(" %10s ns %8s GB/s", HASH_BACKEND_NAMES[backend], "");
+    printf("\n");
+
+    unsigned int sink = 0;
+
+    for (size_t size = BENCH_MIN_SIZE; size <= maxSize; size *= BENCH_SIZE_STEP)
+    {
+        printf("%-10zu %12s", size, "");
+
+        for (int backend = HASH_BACKEND_MURMUR; backend <= HASH_BACKEND_AVX2; backend++)
+        {
+            if (SetHashBackend((HashBackend)backend))
+            {
+                printf(" %13s %13s", "-", "-");
+                continue;
+            }
+
+            double seconds = _benchHash(buffer, bufferSize, size, &sink);
+
+            printf(" %13.1f %13.2f", seconds * 1e9, (double)size / seconds / 1e9);
+        }
+
+        printf("\n");
+        fflush(stdout);
+    }
+
+    printf("checksum = %u\n", sink);
+
+    free(buffer);
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../Stack.hpp"
+
+/**
+ * @brief Push and pop sweeps of a very deep int stack.
+ *
+ * Compares @see Stack, whose big buffers are mremapped huge pages that give
+ * their tail back with MADV_DONTNEED, against the same stack in a @see StackArena,
+ * which never maps and copies big buffers on every resize. Raw arrays grown by
+ * malloc + memcpy and by realloc (glibc mremaps big blocks too) show the cost
+ * without the stack API. The arrays follow the same grow and shrink points as the stack.
+ * Also prints the resident memory after the pop sweep.
+ * Usage: HugeStackBench [depth in MB]
+*/
+
+static const size_t DEFAULT_BENCH_DEPTH_MB = 1024;
+
+enum _ArrayGrowth
+{
+    _ARRAY_COPY,
+    _ARRAY_REALLOC,
+};
+
+struct _BenchResult
+{
+    double pushSeconds;
+    double popSeconds;
+    size_t residentMB;
+};
+
+static double _getSeconds()
+{
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static size_t _getResidentMB()
+{
+    FILE* statm = fopen("/proc/self/statm", "r");
+
+    if (!statm)
+        return 0;
+
+    size_t pages = 0, resident = 0;
+
+    if (fscanf(statm, "%zu %zu", &pages, &resident) != 2)
+        resident = 0;
+
+    fclose(statm);
+
+    return resident * (size_t)sysconf(_SC_PAGESIZE) >> 20;
+}
+
+static int* _resizeArray(int* array, size_t size, size_t newCapacity, _ArrayGrowth growth)
+{
+    if (growth == _ARRAY_REALLOC)
+        return (int*)realloc(array, newCapacity * sizeof(int));
+
+    int* newArray = (int*)malloc(newCapacity * sizeof(int));
+
+    if (newArray)
+        memcpy(newArray, array, min(size, newCapacity) * sizeof(int));
+
+    free(array);
+
+    return newArray;
+}
+
+static _BenchResult _benchArray(size_t depth, _ArrayGrowth growth)
+{
+    size_t capacity = DEFAULT_CAPACITY;
+    size_t size = 0;
+    int* array = (int*)malloc(capacity * sizeof(int));
+
+    double begin = _getSeconds();
+
+    for (size_t i = 0; i < depth; i++)
+    {
+        if (size == capacity)
+        {
+            array = _resizeArray(array, size, capacity * STACK_GROW_FACTOR, growth);
+            capacity *= STACK_GROW_FACTOR;
+        }
+
+        array[size++] = (int)i;
+    }
+
+    double pushed = _getSeconds();
+
+    volatile int sink = 0;
+
+    while (size)
+    {
+        sink = array[--size];
+
+        const StackGrowthPolicy* policy = &DEFAULT_GROWTH_POLICY;
+
+        if (policy->minCapacity < capacity && size <= capacity / policy->shrinkDivisor)
+        {
+            array = _resizeArray(array, size, capacity / policy->growFactor, growth);
+            capacity /= policy->growFactor;
+        }
+    }
+
+    double popped = _getSeconds();
+
+    (void)sink;
+
+    _BenchResult result = {pushed - begin, popped - pushed, _getResidentMB()};
+
+    free(array);
+
+    return result;
+}
+
+static _BenchResult _benchStack(size_t depth, StackArena* arena)
+{
+    Stack<int>* stack = StackInit(int, STACK_PROTECTION_NONE, arena).value;
+
+    if (!stack)
+        return {};
+
+    double begin = _getSeconds();
+
+    for (size_t i = 0; i < depth; i++)
+        Push(stack, (int)i);
+
+    double pushed = _getSeconds();
+
+    volatile int sink = 0;
+
+    for (size_t i = 0; i < depth; i++)
+        sink = Pop(stack).value;
+
+    double popped = _getSeconds();
+
+    (void)sink;
+
+    _BenchResult result = {pushed - begin, popped - pushed, _getResidentMB()};
+
+    StackDestructor(stack);
+
+    return result;
+}
+
+static void _printResult(const char* name, size_t depth, _BenchResult result)
+{
+    printf("%-24s %12.3f %12.3f %12.2f %12zu\n", name, result.pushSeconds, result.popSeconds,
+           (double)(2 * depth) / (result.pushSeconds + result.popSeconds) / 1e6, result.residentMB);
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t depthMB = argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_BENCH_DEPTH_MB;
+    size_t depth = (depthMB << 20) / sizeof(int);
+
+    printf("depth = %zu ints (%zu MB)\n", depth, depthMB);
+    printf("%-24s %12s %12s %12s %12s\n", "", "push s", "pop s", "Mops/s", "RSS after MB");
+
+    _printResult("malloc + memcpy",         depth, _benchArray(depth, _ARRAY_COPY));
+    _printResult("realloc",                 depth, _benchArray(depth, _ARRAY_REALLOC));
+    StackArena* arena = StackArenaCreate().value;
+
+    if (!arena)
+        return ERROR_NO_MEMORY;
+
+    _printResult("Stack in arena, realloc", depth, _benchStack(depth, arena));
+
+    StackArenaDestroy(arena);
+
+    _printResult("Stack mremap + THP",      depth, _benchStack(depth, NULL));
+
+    return 0;
+}
@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../Stack.hpp"
+
+/**
+ * @brief Push/Pop workloads on a Stack<int> with the protections it was compiled with.
+ *
+ * Prints one JSON object per workload and line: the compiled in HASH_PROTECTION,
+ * CANARY_PROTECTION, POISON_PROTECTION and DEBUG, the hash backend, ns per operation, reallocations,
+ * peak resident memory of the workload and TSC cycles spent in @see CalculateHash.
+ * Hash cycles come from a second run of the workload with @see SetHashProfiling on,
+ * so that timing every hash does not slow the first one down.
+ * Deep stacks that would take more than half of the physical memory are skipped.
+ * StackBench.sh builds and runs the bench for every combination of the four defines.
+ * Usage: StackBench [operations per workload] [max deep stack depth]
+*/
+
+static const size_t DEFAULT_BENCH_OPERATIONS = 10000000;
+
+static const size_t DEFAULT_BENCH_MAX_DEPTH = 1000000000;
+
+static const size_t BENCH_MIN_DEPTH = 1000;
+
+static const size_t BENCH_DEPTH_STEP = 10;
+
+static const size_t STEADY_DEPTH = 1000;
+
+static const size_t SAWTOOTH_DEPTH = 1 << 16;
+
+static const size_t BURST_MAX_SIZE = 1 << 16;
+
+/**
+ * @brief Push/pop pairs at the base level between two bursts.
+*/
+static const size_t BURST_PERIOD = 64;
+
+/**
+ * @brief Does the workload on an empty stack.
+ *
+ * @return number of operations done.
+*/
+typedef size_t (*_Workload)(Stack<int>* stack, size_t operations, size_t depth);
+
+struct _BenchCase
+{
+    const char* name;
+    _Workload workload;
+    size_t operations;
+    size_t depth;
+};
+
+struct _BenchResult
+{
+    size_t operations;
+    double seconds;
+    size_t reallocations;
+    size_t peakResidentKB;
+    uint64_t hashCycles;
+};
+
+static double _getSeconds()
+{
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Resets the peak resident memory of the process, Linux 4.0 and later.
+*/
+static void _resetPeakResident()
+{
+    FILE* clearRefs = fopen("/proc/self/clear_refs", "w");
+
+    if (!clearRefs)
+        return;
+
+    fputs("5", clearRefs);
+    fclose(clearRefs);
+}
+
+static size_t _getPeakResidentKB()
+{
+    FILE* status = fopen("/proc/self/status", "r");
+
+    if (!status)
+        return 0;
+
+    char line[128] = "";
+    size_t peakKB = 0;
+
+    while (fgets(line, sizeof(line), status))
+        if (sscanf(line, "VmHWM: %zu", &peakKB) == 1)
+            break;
+
+    fclose(status);
+
+    return peakKB;
+}
+
+static inline void _push(Stack<int>* stack, int value)
+{
+    ErrorCode error = Push(stack, value);
+
+    if (error)
+    {
+        fprintf(stderr, "Push failed with %s\n", ERROR_CODE_NAMES[error]);
+        exit(error);
+    }
+}
+
+static inline int _pop(Stack<int>* stack)
+{
+    StackElementResult<int> result = Pop(stack);
+
+    if (result.error)
+    {
+        fprintf(stderr, "Pop failed with %s\n", ERROR_CODE_NAMES[result.error]);
+        exit(result.error);
+    }
+
+    return result.value;
+}
+
+/**
+ * @brief Push/pop pairs on top of depth elements, the capacity never changes.
+*/
+static size_t _steadyWorkload(Stack<int>* stack, size_t operations, size_t depth)
+{
+    for (size_t i = 0; i < depth; i++)
+        _push(stack, (int)i);
+
+    volatile int sink = 0;
+
+    for (size_t i = 0; i < operations / 2; i++)
+    {
+        _push(stack, (int)i);
+        sink = _pop(stack);
+    }
+
+    for (size_t i = 0; i < depth; i++)
+        sink = _pop(stack);
+
+    (void)sink;
+
+    return 2 * depth + operations / 2 * 2;
+}
+
+/**
+ * @brief Pushes depth elements and pops all of them, over and over, so every tooth grows and shrinks the buffer.
+*/
+static size_t _sawtoothWorkload(Stack<int>* stack, size_t operations, size_t depth)
+{
+    size_t teeth = max(operations / (2 * depth), (size_t)1);
+
+    volatile int sink = 0;
+
+    for (size_t tooth = 0; tooth < teeth; tooth++)
+    {
+        for (size_t i = 0; i < depth; i++)
+            _push(stack, (int)i);
+
+        for (size_t i = 0; i < depth; i++)
+            sink = _pop(stack);
+    }
+
+    (void)sink;
+
+    return teeth * 2 * depth;
+}
+
+/**
+ * @brief Pushes depth elements and pops them.
+*/
+static size_t _deepWorkload(Stack<int>* stack, size_t operations, size_t depth)
+{
+    (void)operations;
+
+    return _sawtoothWorkload(stack, 0, depth);
+}
+
+/**
+ * @brief Push/pop pairs at a base level with bursts of up to depth pushes popped right away.
+*/
+static size_t _burstWorkload(Stack<int>* stack, size_t operations, size_t depth)
+{
+    uint64_t random = 0x2545F4914F6CDD1D;
+
+    volatile int sink = 0;
+    size_t done = 0;
+
+    while (done < operations)
+    {
+        for (size_t i = 0; i < BURST_PERIOD; i++)
+        {
+            _push(stack, (int)i);
+            sink = _pop(stack);
+        }
+
+        random = random * 6364136223846793005 + 1442695040888963407;
+        size_t burst = 1 + (size_t)(random >> 33) % depth;
+
+        for (size_t i = 0; i < burst; i++)
+            _push(stack, (int)i);
+
+        for (size_t i = 0; i < burst; i++)
+            sink = _pop(stack);
+
+        done += 2 * BURST_PERIOD + 2 * burst;
+    }
+
+    (void)sink;
+
+    return done;
+}
+
+static _BenchResult _runCase(const _BenchCase* benchCase, bool profileHash)
+{
+    Stack<int>* stack = StackInit(int, STACK_PROTECTION_HASH).value;
+
+    if (!stack)
+    {
+        fprintf(stderr, "Can't create a stack\n");
+        exit(ERROR_NO_MEMORY);
+    }
+
+    _BenchResult result = {};
+
+    _resetPeakResident();
+
+    if (profileHash)
+        SetHashProfiling(true);
+
+    double begin = _getSeconds();
+
+    result.operations = benchCase->workload(stack, benchCase->operations, benchCase->depth);
+
+    result.seconds = _getSeconds() - begin;
+
+    if (profileHash)
+    {
+        result.hashCycles = GetHashCycles();
+        SetHashProfiling(false);
+    }
+
+    result.reallocations = StackReallocationsCount(stack);
+    result.peakResidentKB = _getPeakResidentKB();
+
+    StackDestructor(stack);
+
+    return result;
+}
+
+static void _benchCase(const _BenchCase* benchCase)
+{
+    _BenchResult result = _runCase(benchCase, false);
+
+    #ifdef HASH_PROTECTION
+    result.hashCycles = _runCase(benchCase, true).hashCycles;
+    #endif
+
+    #ifdef HASH_PROTECTION
+    const bool hash = true;
+    #else
+    const bool hash = false;
+    #endif
+
+    #ifdef CANARY_PROTECTION
+    const bool canary = true;
+    #else
+    const bool canary = false;
+    #endif
+
+    #ifdef POISON_PROTECTION
+    const bool poison = true;
+    #else
+    const bool poison = false;
+    #endif
+
+    #ifdef DEBUG
+    const bool debug = true;
+    #else
+    const bool debug = false;
+    #endif
+
+    printf("{\"hash\": %s, \"canary\": %s, \"poison\": %s, \"debug\": %s, \"hashBackend\": \"%s\", "
+           "\"workload\": \"%s\", \"depth\": %zu, \"operations\": %zu, \"nsPerOp\": %.3f, "
+           "\"reallocations\": %zu, \"peakRssKB\": %zu, \"hashCycles\": %llu, \"hashCyclesPerOp\": %.3f}\n",
+           hash ? "true" : "false", canary ? "true" : "false", poison ? "true" : "false", debug ? "true" : "false",
+           HASH_BACKEND_NAMES[GetHashBackend()], benchCase->name, benchCase->depth, result.operations,
+           result.seconds * 1e9 / (double)result.operations, result.reallocations, result.peakResidentKB,
+           (unsigned long long)result.hashCycles, (double)result.hashCycles / (double)result.operations);
+
+    fflush(stdout);
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t operations = argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_BENCH_OPERATIONS;
+    size_t maxDepth   = argc > 2 ? strtoull(argv[2], NULL, 10) : DEFAULT_BENCH_MAX_DEPTH;
+
+    size_t memorySize = (size_t)sysconf(_SC_PHYS_PAGES) * (size_t)sysconf(_SC_PAGESIZE);
+
+    const _BenchCase cases[] =
+    {
+        {"steady",   _steadyWorkload,   operations, STEADY_DEPTH},
+        {"sawtooth", _sawtoothWorkload, operations, SAWTOOTH_DEPTH},
+        {"burst",    _burstWorkload,    operations, BURST_MAX_SIZE},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        _benchCase(&cases[i]);
+
+    for (size_t depth = BENCH_MIN_DEPTH; depth <= maxDepth; depth *= BENCH_DEPTH_STEP)
+    {
+        // The buffer grows to the next power of two
+        size_t capacity = DEFAULT_CAPACITY;
+        while (capacity < depth)
+            capacity *= STACK_GROW_FACTOR;
+
+        if (capacity * sizeof(int) > memorySize / 2)
+        {
+            fprintf(stderr, "Skipping depth %zu, not enough memory\n", depth);
+            continue;
+        }
+
+        _BenchCase deepCase = {"deep", _deepWorkload, 2 * depth, depth};
+
+        _benchCase(&deepCase);
+    }
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Builds StackBench with every combination of HASH_PROTECTION, CANARY_PROTECTION, POISON_PROTECTION and DEBUG
+# and runs it, so stdout gets one JSON line per configuration and workload.
+# Usage: Bench/StackBench.sh [StackBench arguments], CXX and CXXFLAGS are respected.
+
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+for hash in "" -DNO_HASH_PROTECTION; do
+    for canary in "" -DNO_CANARY_PROTECTION; do
+        for poison in "" -DNO_POISON_PROTECTION; do
+            for debug in "" -DNDEBUG; do
+                ${CXX:-g++} -std=c++17 ${CXXFLAGS:--O2} -pthread $hash $canary $poison $debug -o "$build/StackBench" \
+                    "$root/Bench/StackBench.cpp" "$root/Stack.cpp" "$root/StackArena.cpp" "$root/StackPages.cpp" \
+                    "$root/StackLog.cpp" "$root/StackPoison.cpp" "$root/StackStats.cpp" "$root/Utils.cpp"
+
+                (cd "$build" && ./StackBench "$@")
+            done
+        done
+    done
+done
@@ -0,0 +1,306 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "ConcurrentStack.hpp"
+
+/**
+ * @brief Hazard pointer of a thread. Records are never freed, a finished thread leaves its record for reuse.
+*/
+struct _HazardRecord
+{
+    void* hazard;
+    bool active;
+    _HazardRecord* next;
+};
+
+struct _RetiredNode
+{
+    void* node;
+    void (*deleter)(void*);
+};
+
+/**
+ * @brief Per thread reclamation state.
+*/
+struct _HazardThread
+{
+    _HazardRecord* record;
+
+    _RetiredNode* retired;
+    size_t retiredSize;
+    size_t retiredCapacity;
+};
+
+static _HazardRecord* _HAZARD_RECORDS = NULL;
+
+static pthread_key_t _HAZARD_THREAD_KEY;
+
+static pthread_once_t _HAZARD_ONCE = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Nodes left by finished threads, adopted by the next scan.
+*/
+static pthread_mutex_t _ORPHANS_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+
+static _RetiredNode* _ORPHANS = NULL;
+
+static size_t _ORPHANS_SIZE = 0;
+
+static size_t _ORPHANS_CAPACITY = 0;
+
+/**
+ * @brief Lets scans skip the mutex when there are no orphans.
+*/
+static bool _HAS_ORPHANS = false;
+
+static _HazardThread* _getHazardThread();
+
+static void _hazardThreadExit(void* thread);
+
+static void _hazardCreateKey();
+
+static _HazardRecord* _acquireHazardRecord();
+
+static ErrorCode _addRetired(_RetiredNode** retired, size_t* size, size_t* capacity, _RetiredNode node);
+
+static void _hazardScan(_HazardThread* thread);
+
+static void _adoptOrphans(_HazardThread* thread);
+
+static int _comparePointers(const void* first, const void* second);
+
+_EliminationState* _getEliminationState()
+{
+    static thread_local _EliminationState state = {};
+
+    if (state.range == 0)
+    {
+        state.range = 1;
+        state.spins = ELIMINATION_MIN_SPINS;
+        state.seed  = (uint64_t)(uintptr_t)&state | 1;
+    }
+
+    return &state;
+}
+
+void* _hazardProtect(void** source)
+{
+    _HazardRecord* record = _getHazardThread()->record;
+
+    void* pointer = __atomic_load_n(source, __ATOMIC_RELAXED);
+
+    while (true)
+    {
+        __atomic_store_n(&record->hazard, pointer, __ATOMIC_SEQ_CST);
+
+        void* current = __atomic_load_n(source, __ATOMIC_SEQ_CST);
+
+        if (current == pointer)
+            return pointer;
+
+        pointer = current;
+    }
+}
+
+void _hazardClear()
+{
+    __atomic_store_n(&_getHazardThread()->record->hazard, NULL, __ATOMIC_RELEASE);
+}
+
+void _hazardRetire(void* node, void (*deleter)(void*))
+{
+    _HazardThread* thread = _getHazardThread();
+
+    if (_addRetired(&thread->retired, &thread->retiredSize, &thread->retiredCapacity, {node, deleter}))
+    {
+        _hazardScan(thread);
+
+        if (_addRetired(&thread->retired, &thread->retiredSize, &thread->retiredCapacity, {node, deleter}))
+        {
+            // Nowhere to keep it, leaking is the only safe option
+            return;
+        }
+    }
+
+    if (thread->retiredSize >= HAZARD_SCAN_THRESHOLD)
+        _hazardScan(thread);
+}
+
+static _HazardThread* _getHazardThread()
+{
+    static thread_local _HazardThread* thread = NULL;
+
+    if (thread)
+        return thread;
+
+    pthread_once(&_HAZARD_ONCE, _hazardCreateKey);
+
+    thread = (_HazardThread*)calloc(1, sizeof(_HazardThread));
+
+    if (!thread)
+    {
+        SetConsoleColor(stderr, COLOR_RED);
+        fprintf(stderr, "ERROR!!! COULDN'T ALLOCATE HAZARD POINTER!!!!\n");
+        SetConsoleColor(stderr, COLOR_WHITE);
+
+        abort();
+    }
+
+    thread->record = _acquireHazardRecord();
+
+    pthread_setspecific(_HAZARD_THREAD_KEY, thread);
+
+    return thread;
+}
+
+static void _hazardCreateKey()
+{
+    pthread_key_create(&_HAZARD_THREAD_KEY, _hazardThreadExit);
+}
+
+/**
+ * @brief Releases the thread's record and hands its retired nodes to the others.
+*/
+static void _hazardThreadExit(void* threadPtr)
+{
+    _HazardThread* thread = (_HazardThread*)threadPtr;
+
+    __atomic_store_n(&thread->record->hazard, NULL, __ATOMIC_RELEASE);
+
+    _hazardScan(thread);
+
+    pthread_mutex_lock(&_ORPHANS_MUTEX);
+
+    for (size_t i = 0; i < thread->retiredSize; i++)
+        _addRetired(&_ORPHANS, &_ORPHANS_SIZE, &_ORPHANS_CAPACITY, thread->retired[i]);
+
+    __atomic_store_n(&_HAS_ORPHANS, _ORPHANS_SIZE != 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&_ORPHANS_MUTEX);
+
+    __atomic_store_n(&thread->record->active, false, __ATOMIC_RELEASE);
+
+    free(thread->retired);
+    free(thread);
+}
+
+static _HazardRecord* _acquireHazardRecord()
+{
+    for (_HazardRecord* record = __atomic_load_n(&_HAZARD_RECORDS, __ATOMIC_ACQUIRE); record; record = record->next)
+    {
+        bool expected = false;
+
+        if (!__atomic_load_n(&record->active, __ATOMIC_RELAXED) &&
+            __atomic_compare_exchange_n(&record->active, &expected, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return record;
+    }
+
+    _HazardRecord* record = (_HazardRecord*)calloc(1, sizeof(_HazardRecord));
+
+    if (!record)
+    {
+        SetConsoleColor(stderr, COLOR_RED);
+        fprintf(stderr, "ERROR!!! COULDN'T ALLOCATE HAZARD POINTER!!!!\n");
+        SetConsoleColor(stderr, COLOR_WHITE);
+
+        abort();
+    }
+
+    record->active = true;
+    record->next = __atomic_load_n(&_HAZARD_RECORDS, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(&_HAZARD_RECORDS, &record->next, record, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+
+    return record;
+}
+
+static ErrorCode _addRetired(_RetiredNode** retired, size_t* size, size_t* capacity, _RetiredNode node)
+{
+    if (*size == *capacity)
+    {
+        size_t newCapacity = *capacity ? *capacity * STACK_GROW_FACTOR : HAZARD_SCAN_THRESHOLD;
+
+        _RetiredNode* newRetired = (_RetiredNode*)realloc(*retired, newCapacity * sizeof(_RetiredNode));
+
+        if (!newRetired)
+            return ERROR_NO_MEMORY;
+
+        *retired = newRetired;
+        *capacity = newCapacity;
+    }
+
+    (*retired)[(*size)++] = node;
+
+    return EVERYTHING_FINE;
+}
+
+/**
+ * @brief Frees every retired node no hazard pointer points to.
+ *
+ * Hazards are collected and sorted once, so a scan costs O(R log H)
+ * for R retired nodes and H threads.
+*/
+static void _hazardScan(_HazardThread* thread)
+{
+    _adoptOrphans(thread);
+
+    // Records are only ever pushed to the head, so both walks over one snapshot see the same records
+    _HazardRecord* records = __atomic_load_n(&_HAZARD_RECORDS, __ATOMIC_ACQUIRE);
+
+    size_t hazardsCount = 0;
+    for (_HazardRecord* record = records; record; record = record->next)
+        hazardsCount++;
+
+    void** hazards = (void**)calloc(hazardsCount ? hazardsCount : 1, sizeof(void*));
+
+    if (!hazards)
+        return;
+
+    size_t protectedCount = 0;
+    for (_HazardRecord* record = records; record; record = record->next)
+    {
+        void* hazard = __atomic_load_n(&record->hazard, __ATOMIC_SEQ_CST);
+
+        if (hazard)
+            hazards[protectedCount++] = hazard;
+    }
+
+    qsort(hazards, protectedCount, sizeof(void*), _comparePointers);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < thread->retiredSize; i++)
+    {
+        _RetiredNode node = thread->retired[i];
+
+        if (bsearch(&node.node, hazards, protectedCount, sizeof(void*), _comparePointers))
+            thread->retired[kept++] = node;
+        else
+            node.deleter(node.node);
+    }
+
+    thread->retiredSize = kept;
+
+    free(hazards);
+}
+
+static void _adoptOrphans(_HazardThread* thread)
+{
+    if (!__atomic_load_n(&_HAS_ORPHANS, __ATOMIC_RELAXED) || pthread_mutex_trylock(&_ORPHANS_MUTEX) != 0)
+        return;
+
+    while (_ORPHANS_SIZE &&
+           !_addRetired(&thread->retired, &thread->retiredSize, &thread->retiredCapacity, _ORPHANS[_ORPHANS_SIZE - 1]))
+        _ORPHANS_SIZE--;
+
+    __atomic_store_n(&_HAS_ORPHANS, _ORPHANS_SIZE != 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&_ORPHANS_MUTEX);
+}
+
+static int _comparePointers(const void* first, const void* second)
+{
+    uintptr_t firstPointer  = (uintptr_t)*(void* const*)first;
+    uintptr_t secondPointer = (uintptr_t)*(void* const*)second;
+
+    return (firstPointer > secondPointer) - (firstPointer < secondPointer);
+}
@@ -0,0 +1,487 @@
+//! @file
+
+#ifndef CONCURRENT_STACK_HPP
+#define CONCURRENT_STACK_HPP
+
+#include <stdlib.h>
+#include <new>
+#include <utility>
+#include "Stack.hpp"
+#include "MinMax.hpp"
+
+/**
+ * @brief Lock-free stack of T (Treiber stack).
+ *
+ * Push and Pop may be called from any number of threads at once.
+ * Popped nodes are reclaimed through hazard pointers, so a node is never
+ * freed or reused while another thread may still read it, which also rules out ABA.
+ *
+ * When the top is contended Push and Pop meet in an elimination array:
+ * a push hands its node directly to a pop and neither touches the top.
+ *
+ * Only the header canaries are checked, there are no hashes and no poison:
+ * elements live in separate nodes, not in one buffer.
+*/
+template <typename T>
+struct ConcurrentStack;
+
+/**
+ * @brief Struct that @see ConcurrentStackInit returns. If error is not 0, then value = NULL.
+ *
+ * @var ConcurrentStackResult::value - pointer to the stack.
+ * @var ConcurrentStackResult::error - error message @see ErrorCode.
+*/
+template <typename T>
+struct ConcurrentStackResult
+{
+    ConcurrentStack<T>* value;
+    ErrorCode error;
+};
+
+/**
+ * @brief Contention counters of a @see ConcurrentStack.
+ *
+ * @var ConcurrentStackStats::casFailures - failed updates of the top.
+ * @var ConcurrentStackStats::eliminationAttempts - pushes and pops that tried the elimination array.
+ * @var ConcurrentStackStats::eliminated - push/pop pairs that met in the array, each one is two operations.
+*/
+struct ConcurrentStackStats
+{
+    size_t casFailures;
+    size_t eliminationAttempts;
+    size_t eliminated;
+};
+
+/**
+ * @brief Initializes a lock-free stack.
+ *
+ * @param [in] type - element type.
+ *
+ * @return ConcurrentStackResult<type>.
+*/
+#define ConcurrentStackInit(type)                                                        \
+({                                                                                       \
+    SourceCodePosition _owner = {__FILE__, __LINE__, __func__};                          \
+    _concurrentStackInit<type>(&_owner);                                                 \
+})
+
+template <typename T>
+ConcurrentStackResult<T> _concurrentStackInit(SourceCodePosition* owner);
+
+/**
+ * @brief Destroys the stack and the elements left in it.
+ *
+ * @note No other thread may use the stack at this point.
+ *
+ * @param [in] stack - the stack to destroy.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode StackDestructor(ConcurrentStack<T>* stack);
+
+/**
+ * @brief Checks the stack canaries.
+ *
+ * @param [in] stack - the stack to check.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode CheckStackIntegrity(ConcurrentStack<T>* stack);
+
+/**
+ * @brief Moves an element on top of the stack, thread safe.
+ *
+ * @param [in] stack - the stack.
+ * @param [in] value - the value.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode Push(ConcurrentStack<T>* stack, T value);
+
+/**
+ * @brief Removes the top element and moves it out, thread safe.
+ *
+ * @param [in] stack - the stack.
+ *
+ * @return @see StackElementResult, ERROR_INDEX_OUT_OF_BOUNDS if the stack is empty.
+*/
+template <typename T>
+StackElementResult<T> Pop(ConcurrentStack<T>* stack);
+
+/**
+ * @brief Returns the contention counters, they are updated with relaxed atomics.
+ *
+ * @param [in] stack - the stack.
+ *
+ * @return @see ConcurrentStackStats, zeroes if the stack is NULL.
+*/
+template <typename T>
+ConcurrentStackStats ConcurrentStackGetStats(ConcurrentStack<T>* stack);
+
+/**
+ * @brief Protects the pointer from being freed by other threads until @see _hazardClear.
+ *
+ * Returns the value of *source that is now safe to dereference.
+ * Each thread has a single hazard pointer.
+*/
+void* _hazardProtect(void** source);
+
+/**
+ * @brief Drops the current thread's hazard pointer.
+*/
+void _hazardClear();
+
+/**
+ * @brief Frees the node with deleter once no hazard pointer points to it.
+*/
+void _hazardRetire(void* node, void (*deleter)(void*));
+
+/**
+ * @brief Per thread elimination state, shared by all stacks.
+ *
+ * @var _EliminationState::range - how many slots of the array are used.
+ * @var _EliminationState::spins - how long to wait for a partner.
+ * @var _EliminationState::seed - random slot generator state.
+*/
+struct _EliminationState
+{
+    size_t range;
+    size_t spins;
+    uint64_t seed;
+};
+
+_EliminationState* _getEliminationState();
+
+/**
+ * @brief Marks a slot whose node was taken by a pop, the pushing thread frees the slot.
+*/
+static void* const _ELIMINATION_TAKEN = (void*)1;
+
+struct alignas(64) _EliminationSlot
+{
+    void* node;
+};
+
+static inline void _cpuRelax()
+{
+    #if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+    #endif
+}
+
+template <typename T>
+struct _ConcurrentStackNode
+{
+    _ConcurrentStackNode* next;
+    T value;
+};
+
+template <typename T>
+struct ConcurrentStack
+{
+    #ifdef CANARY_PROTECTION
+    canary_t leftCanary;
+    #endif
+
+    SourceCodePosition origin;
+
+    alignas(64) _ConcurrentStackNode<T>* top;
+
+    _EliminationSlot eliminationSlots[ELIMINATION_ARRAY_SIZE];
+
+    alignas(64) ConcurrentStackStats stats;
+
+    #ifdef CANARY_PROTECTION
+    alignas(64) canary_t rightCanary;
+    #endif
+};
+
+template <typename T>
+static bool _eliminatePush(ConcurrentStack<T>* stack, _ConcurrentStackNode<T>* node);
+
+template <typename T>
+static _ConcurrentStackNode<T>* _eliminatePop(ConcurrentStack<T>* stack);
+
+template <typename T>
+ConcurrentStackResult<T> _concurrentStackInit(SourceCodePosition* origin)
+{
+    void* memory = aligned_alloc(alignof(ConcurrentStack<T>), sizeof(ConcurrentStack<T>));
+
+    if (!memory)
+        return {NULL, ERROR_NO_MEMORY};
+
+    ConcurrentStack<T>* stack = (ConcurrentStack<T>*)memory;
+
+    *stack = {};
+
+    stack->origin = *origin;
+    stack->top = NULL;
+
+    #ifdef CANARY_PROTECTION
+    stack->leftCanary = _CANARY;
+    stack->rightCanary = _CANARY;
+    #endif
+
+    return {stack, EVERYTHING_FINE};
+}
+
+template <typename T>
+ErrorCode StackDestructor(ConcurrentStack<T>* stack)
+{
+    ErrorCode error = CheckStackIntegrity(stack);
+    RETURN_ERROR(error);
+
+    _ConcurrentStackNode<T>* node = stack->top;
+
+    while (node)
+    {
+        _ConcurrentStackNode<T>* next = node->next;
+
+        node->value.~T();
+        free(node);
+
+        node = next;
+    }
+
+    stack->top = NULL;
+    stack->origin = {};
+
+    #ifdef CANARY_PROTECTION
+    stack->leftCanary = SIZET_POISON;
+    stack->rightCanary = SIZET_POISON;
+    #endif
+
+    free(stack);
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode CheckStackIntegrity(ConcurrentStack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    #ifdef CANARY_PROTECTION
+    if (stack->leftCanary != _CANARY || stack->rightCanary != _CANARY)
+        return ERROR_DEAD_CANARY;
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode Push(ConcurrentStack<T>* stack, T value)
+{
+    ErrorCode error = CheckStackIntegrity(stack);
+    RETURN_ERROR(error);
+
+    _ConcurrentStackNode<T>* node = (_ConcurrentStackNode<T>*)malloc(sizeof(_ConcurrentStackNode<T>));
+
+    if (!node)
+        return ERROR_NO_MEMORY;
+
+    new (&node->value) T(std::move(value));
+
+    while (true)
+    {
+        node->next = __atomic_load_n(&stack->top, __ATOMIC_RELAXED);
+
+        if (__atomic_compare_exchange_n(&stack->top, &node->next, node, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return EVERYTHING_FINE;
+
+        __atomic_fetch_add(&stack->stats.casFailures, 1, __ATOMIC_RELAXED);
+
+        if (_eliminatePush(stack, node))
+            return EVERYTHING_FINE;
+    }
+}
+
+template <typename T>
+StackElementResult<T> Pop(ConcurrentStack<T>* stack)
+{
+    ErrorCode error = CheckStackIntegrity(stack);
+
+    if (error)
+        return {T(), error};
+
+    _ConcurrentStackNode<T>* node = NULL;
+
+    while (true)
+    {
+        node = (_ConcurrentStackNode<T>*)_hazardProtect((void**)&stack->top);
+
+        if (!node)
+        {
+            _hazardClear();
+            return {T(), ERROR_INDEX_OUT_OF_BOUNDS};
+        }
+
+        _ConcurrentStackNode<T>* next = node->next;
+
+        if (__atomic_compare_exchange_n(&stack->top, &node, next, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+
+        __atomic_fetch_add(&stack->stats.casFailures, 1, __ATOMIC_RELAXED);
+
+        node = _eliminatePop(stack);
+
+        if (node)
+        {
+            _hazardClear();
+
+            T value = std::move(node->value);
+            node->value.~T();
+
+            // The node never was in the stack, nobody else can see it
+            free(node);
+
+            return {std::move(value), EVERYTHING_FINE};
+        }
+    }
+
+    _hazardClear();
+
+    T value = std::move(node->value);
+    node->value.~T();
+
+    _hazardRetire(node, free);
+
+    return {std::move(value), EVERYTHING_FINE};
+}
+
+template <typename T>
+ConcurrentStackStats ConcurrentStackGetStats(ConcurrentStack<T>* stack)
+{
+    if (!stack)
+        return {};
+
+    return
+    {
+        .casFailures         = __atomic_load_n(&stack->stats.casFailures,         __ATOMIC_RELAXED),
+        .eliminationAttempts = __atomic_load_n(&stack->stats.eliminationAttempts, __ATOMIC_RELAXED),
+        .eliminated          = __atomic_load_n(&stack->stats.eliminated,          __ATOMIC_RELAXED),
+    };
+}
+
+/**
+ * @brief Picks a slot in the thread's current range.
+*/
+template <typename T>
+static _EliminationSlot* _getEliminationSlot(ConcurrentStack<T>* stack, _EliminationState* state)
+{
+    state->seed ^= state->seed << 13;
+    state->seed ^= state->seed >> 7;
+    state->seed ^= state->seed << 17;
+
+    return &stack->eliminationSlots[state->seed % state->range];
+}
+
+/**
+ * @brief Adapts the thread's elimination state.
+ *
+ * A collision on a slot means the array is too small, so the range grows.
+ * A timeout means there are too few partners, so the range shrinks and the wait gets longer.
+ * A successful exchange makes the wait shorter again.
+*/
+static inline void _eliminationCollided(_EliminationState* state)
+{
+    state->range = min(state->range * 2, ELIMINATION_ARRAY_SIZE);
+}
+
+static inline void _eliminationTimedOut(_EliminationState* state)
+{
+    state->range = max(state->range / 2, (size_t)1);
+    state->spins = min(state->spins * 2, ELIMINATION_MAX_SPINS);
+}
+
+static inline void _eliminationSucceeded(_EliminationState* state)
+{
+    state->spins = max(state->spins / 2, ELIMINATION_MIN_SPINS);
+}
+
+/**
+ * @brief Offers the node to a pop in the elimination array.
+ *
+ * @param [in] stack - the stack.
+ * @param [in] node - node to hand over, it is not in the stack.
+ *
+ * @return true if a pop took the node.
+*/
+template <typename T>
+static bool _eliminatePush(ConcurrentStack<T>* stack, _ConcurrentStackNode<T>* node)
+{
+    _EliminationState* state = _getEliminationState();
+    _EliminationSlot* slot = _getEliminationSlot(stack, state);
+
+    __atomic_fetch_add(&stack->stats.eliminationAttempts, 1, __ATOMIC_RELAXED);
+
+    void* expected = NULL;
+    if (!__atomic_compare_exchange_n(&slot->node, &expected, (void*)node, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+        _eliminationCollided(state);
+        return false;
+    }
+
+    for (size_t spin = 0; spin < state->spins && __atomic_load_n(&slot->node, __ATOMIC_RELAXED) == node; spin++)
+        _cpuRelax();
+
+    expected = node;
+    if (__atomic_compare_exchange_n(&slot->node, &expected, NULL, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        _eliminationTimedOut(state);
+        return false;
+    }
+
+    // Only a pop could have replaced the node, and it did so with _ELIMINATION_TAKEN
+    __atomic_store_n(&slot->node, NULL, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&stack->stats.eliminated, 1, __ATOMIC_RELAXED);
+    _eliminationSucceeded(state);
+
+    return true;
+}
+
+/**
+ * @brief Takes a node offered by a push in the elimination array.
+ *
+ * @param [in] stack - the stack.
+ *
+ * @return the node, owned by the caller, or NULL.
+*/
+template <typename T>
+static _ConcurrentStackNode<T>* _eliminatePop(ConcurrentStack<T>* stack)
+{
+    _EliminationState* state = _getEliminationState();
+    _EliminationSlot* slot = _getEliminationSlot(stack, state);
+
+    __atomic_fetch_add(&stack->stats.eliminationAttempts, 1, __ATOMIC_RELAXED);
+
+    for (size_t spin = 0; spin < state->spins; spin++)
+    {
+        void* offered = __atomic_load_n(&slot->node, __ATOMIC_RELAXED);
+
+        if (offered && offered != _ELIMINATION_TAKEN)
+        {
+            if (__atomic_compare_exchange_n(&slot->node, &offered, _ELIMINATION_TAKEN, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            {
+                _eliminationSucceeded(state);
+                return (_ConcurrentStackNode<T>*)offered;
+            }
+
+            _eliminationCollided(state);
+            return NULL;
+        }
+
+        _cpuRelax();
+    }
+
+    _eliminationTimedOut(state);
+
+    return NULL;
+}
+
+#endif
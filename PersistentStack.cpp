@@ -0,0 +1,181 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "PersistentStack.hpp"
+
+/**
+ * @brief "PERSTACK", followed by the format version.
+*/
+static const uint64_t _PERSISTENT_MAGIC = 0x4B43415453524550;
+
+static const uint64_t _PERSISTENT_FORMAT_VERSION = 1;
+
+/**
+ * @brief Canaries in the file must not depend on the process, unlike @see _CANARY.
+*/
+static const canary_t _PERSISTENT_CANARY = 0xC0DEDBADF00DCAFE;
+
+static hash_t _calculateRecordHash(const _PersistentRecord* record);
+
+ErrorCode _persistentMapFile(const char* path, size_t minSize, int* fd, char** mapping, size_t* size, bool* created)
+{
+    MyAssertSoft(path, ERROR_NULLPTR);
+
+    int file = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (file < 0)
+        return ERROR_BAD_FILE;
+
+    struct stat fileStat = {};
+
+    if (flock(file, LOCK_EX | LOCK_NB) != 0 || fstat(file, &fileStat) != 0)
+    {
+        close(file);
+        return ERROR_BAD_FILE;
+    }
+
+    size_t fileSize = (size_t)fileStat.st_size;
+
+    *created = fileSize == 0;
+
+    if (fileSize < minSize)
+    {
+        if (!*created)
+        {
+            close(file);
+            return ERROR_BAD_FILE;
+        }
+
+        if (ftruncate(file, (off_t)minSize) != 0)
+        {
+            close(file);
+            return ERROR_NO_MEMORY;
+        }
+
+        fileSize = minSize;
+    }
+
+    char* fileMapping = (char*)mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+
+    if (fileMapping == MAP_FAILED)
+    {
+        close(file);
+        return ERROR_NO_MEMORY;
+    }
+
+    *fd = file;
+    *mapping = fileMapping;
+    *size = fileSize;
+
+    return EVERYTHING_FINE;
+}
+
+ErrorCode _persistentGrowFile(int fd, char** mapping, size_t* size, size_t newSize)
+{
+    if (ftruncate(fd, (off_t)newSize) != 0)
+        return ERROR_NO_MEMORY;
+
+    char* newMapping = (char*)mremap(*mapping, *size, newSize, MREMAP_MAYMOVE);
+
+    if (newMapping == MAP_FAILED)
+        return ERROR_NO_MEMORY;
+
+    *mapping = newMapping;
+    *size = newSize;
+
+    return EVERYTHING_FINE;
+}
+
+void _persistentUnmapFile(int fd, char* mapping, size_t size)
+{
+    munmap(mapping, size);
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+ErrorCode _persistentSyncRange(char* mapping, size_t from, size_t to)
+{
+    size_t pageSize = _getPageSize();
+
+    from = from / pageSize * pageSize;
+
+    if (from >= to)
+        return EVERYTHING_FINE;
+
+    if (msync(mapping + from, to - from, MS_SYNC) != 0)
+        return ERROR_BAD_FILE;
+
+    return EVERYTHING_FINE;
+}
+
+void _persistentInitHeader(_PersistentHeader* header, size_t elementSize)
+{
+    *header =
+    {
+        .leftCanary = _PERSISTENT_CANARY,
+        .magic = _PERSISTENT_MAGIC ^ _PERSISTENT_FORMAT_VERSION,
+        .elementSize = elementSize,
+        .records = {},
+        .rightCanary = _PERSISTENT_CANARY,
+    };
+}
+
+ErrorCode _persistentCheckHeader(const _PersistentHeader* header, size_t elementSize)
+{
+    MyAssertSoft(header, ERROR_NULLPTR);
+
+    if (header->leftCanary != _PERSISTENT_CANARY || header->rightCanary != _PERSISTENT_CANARY)
+        return ERROR_DEAD_CANARY;
+
+    if (header->magic != (_PERSISTENT_MAGIC ^ _PERSISTENT_FORMAT_VERSION) || header->elementSize != elementSize)
+        return ERROR_BAD_FILE;
+
+    return EVERYTHING_FINE;
+}
+
+const _PersistentRecord* _persistentLastRecord(const _PersistentHeader* header)
+{
+    const _PersistentRecord* last = NULL;
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        const _PersistentRecord* record = &header->records[i];
+
+        if (record->sequence == 0 || record->recordHash != _calculateRecordHash(record))
+            continue;
+
+        if (!last || record->sequence > last->sequence)
+            last = record;
+    }
+
+    return last;
+}
+
+ErrorCode _persistentCommit(_PersistentHeader* header, size_t committedSize, hash_t dataHash)
+{
+    MyAssertSoft(header, ERROR_NULLPTR);
+
+    const _PersistentRecord* last = _persistentLastRecord(header);
+
+    uint64_t sequence = last ? last->sequence + 1 : 1;
+
+    _PersistentRecord* record = &header->records[sequence % 2];
+
+    record->sequence = sequence;
+    record->committedSize = committedSize;
+    record->dataHash = dataHash;
+    record->recordHash = _calculateRecordHash(record);
+
+    return _persistentSyncRange((char*)header, 0, sizeof(_PersistentHeader));
+}
+
+static hash_t _calculateRecordHash(const _PersistentRecord* record)
+{
+    _PersistentRecord recordCopy = *record;
+    recordCopy.recordHash = 0;
+
+    return CalculatePortableHash((const void*)&recordCopy, sizeof(recordCopy), HASH_SEED);
+}
@@ -0,0 +1,533 @@
+//! @file
+
+#ifndef PERSISTENT_STACK_HPP
+#define PERSISTENT_STACK_HPP
+
+#include "Stack.hpp"
+
+/**
+ * @brief Stack of T that lives in a memory-mapped file and survives restarts.
+ *
+ * Elements are written straight to the shared mapping. @see StackSync makes them
+ * durable: it flushes only the pages written since the previous sync and then
+ * commits a record with the size and the data hash. Reopening the file restores
+ * the last committed state, checked by the header canaries, the record hash and
+ * the data hash.
+ *
+ * Committed elements are never overwritten before the commit is lowered, so a crash
+ * at any point leaves the last commit intact: a Push over a popped committed element
+ * first commits the current size, which costs one header flush.
+ *
+ * T must be @see STACK_TRIVIAL. Protection is at most @see STACK_PROTECTION_CANARY,
+ * the data hash is always kept. The file is locked while it is open.
+*/
+template <typename T>
+struct PersistentStack;
+
+/**
+ * @brief Struct that @see PersistentStackOpen returns. If error is not 0, then value = NULL.
+ *
+ * @var PersistentStackResult::value - pointer to the stack.
+ * @var PersistentStackResult::error - error message @see ErrorCode.
+*/
+template <typename T>
+struct PersistentStackResult
+{
+    PersistentStack<T>* value;
+    ErrorCode error;
+};
+
+/**
+ * @brief Opens a persistent stack, the file is created if it does not exist.
+ *
+ * @param [in] type - element type.
+ * @param [in] path - the file.
+ * @param [in] protection - optional @see StackProtection, @see DEFAULT_PROTECTION if omitted.
+ *
+ * @return PersistentStackResult<type>, ERROR_BAD_FILE if the file can't be opened, is locked
+ * or is not a stack of type, ERROR_DEAD_CANARY or ERROR_BAD_HASH if it is corrupted.
+*/
+#define PersistentStackOpen(type, path, ...)                                             \
+({                                                                                       \
+    SourceCodePosition _owner = {__FILE__, __LINE__, __func__};                          \
+    _persistentStackOpen<type>(&_owner, path, ##__VA_ARGS__);                            \
+})
+
+template <typename T>
+PersistentStackResult<T> _persistentStackOpen(SourceCodePosition* owner, const char* path,
+                                              StackProtection protection = DEFAULT_PROTECTION);
+
+/**
+ * @brief Syncs and closes the stack, the file keeps it.
+ *
+ * @param [in] stack - the stack to close.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode StackDestructor(PersistentStack<T>* stack);
+
+/**
+ * @brief Checks the stack and its file header.
+ *
+ * @param [in] stack - the stack to check.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode CheckStackIntegrity(PersistentStack<T>* stack);
+
+/**
+ * @brief Makes the current state durable, a reopened file starts from it.
+ *
+ * Flushes the pages written since the last sync, then commits the size and the data hash.
+ *
+ * @param [in] stack - the stack.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode StackSync(PersistentStack<T>* stack);
+
+/**
+ * @brief Puts an element on top of the stack.
+ *
+ * @param [in] stack - the stack.
+ * @param [in] value - the value.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode Push(PersistentStack<T>* stack, T value);
+
+/**
+ * @brief Removes the top element.
+ *
+ * @param [in] stack - the stack.
+ *
+ * @return @see StackElementResult, ERROR_INDEX_OUT_OF_BOUNDS if the stack is empty.
+*/
+template <typename T>
+StackElementResult<T> Pop(PersistentStack<T>* stack);
+
+template <typename T>
+ErrorCode _stackDump(FILE* where, PersistentStack<T>* stack, SourceCodePosition* caller, ErrorCode error);
+
+/**
+ * @brief Commit record, the header keeps two and overwrites the older one,
+ * so a torn write leaves the previous commit valid.
+*/
+struct _PersistentRecord
+{
+    uint64_t sequence;
+    size_t committedSize;
+    hash_t dataHash;
+    hash_t recordHash;
+};
+
+/**
+ * @brief Beginning of the file, the data starts at @see _PERSISTENT_DATA_OFFSET.
+*/
+struct _PersistentHeader
+{
+    canary_t leftCanary;
+
+    uint64_t magic;
+    size_t elementSize;
+
+    _PersistentRecord records[2];
+
+    canary_t rightCanary;
+};
+
+static const size_t _PERSISTENT_DATA_OFFSET = 4096;
+
+/**
+ * @brief Maps the file at path, creating or extending it to minSize bytes, and locks it.
+ *
+ * @param [out] created - whether the file was empty.
+*/
+ErrorCode _persistentMapFile(const char* path, size_t minSize, int* fd, char** mapping, size_t* size, bool* created);
+
+/**
+ * @brief Extends the file to newSize bytes and remaps it.
+*/
+ErrorCode _persistentGrowFile(int fd, char** mapping, size_t* size, size_t newSize);
+
+/**
+ * @brief Unlocks and unmaps the file.
+*/
+void _persistentUnmapFile(int fd, char* mapping, size_t size);
+
+/**
+ * @brief Flushes mapping bytes [from, to) to the file.
+*/
+ErrorCode _persistentSyncRange(char* mapping, size_t from, size_t to);
+
+/**
+ * @brief Fills the header of a new file.
+*/
+void _persistentInitHeader(_PersistentHeader* header, size_t elementSize);
+
+/**
+ * @brief Checks the header canaries, magic and element size.
+*/
+ErrorCode _persistentCheckHeader(const _PersistentHeader* header, size_t elementSize);
+
+/**
+ * @brief Returns the valid record with the highest sequence, NULL if there is none.
+*/
+const _PersistentRecord* _persistentLastRecord(const _PersistentHeader* header);
+
+/**
+ * @brief Writes a record over the older one and flushes the header.
+*/
+ErrorCode _persistentCommit(_PersistentHeader* header, size_t committedSize, hash_t dataHash);
+
+template <typename T>
+struct PersistentStack
+{
+    #ifdef CANARY_PROTECTION
+    canary_t leftCanary;
+    #endif
+
+    SourceCodePosition origin;
+    StackProtection protection;
+
+    int fd;
+    char* mapping;
+    size_t mappingSize;
+
+    T* data;
+    size_t size;
+    size_t capacity;
+
+    size_t committedSize;
+    hash_t dataHash;
+
+    size_t dirtyFrom;
+
+    #ifdef CANARY_PROTECTION
+    canary_t rightCanary;
+    #endif
+};
+
+template <typename T>
+static inline hash_t _persistentSlotHash(size_t index, const T& value)
+{
+    return CalculatePortableHash((const void*)&value, sizeof(T), HASH_SEED ^ (hash_t)(index * 0x9E3779B9));
+}
+
+template <typename T>
+static inline size_t _getPersistentCapacity(size_t mappingSize)
+{
+    return (mappingSize - _PERSISTENT_DATA_OFFSET) / sizeof(T);
+}
+
+template <typename T>
+static ErrorCode _checkPersistentStackFast(PersistentStack<T>* stack);
+
+template <typename T>
+PersistentStackResult<T> _persistentStackOpen(SourceCodePosition* origin, const char* path, StackProtection protection)
+{
+    static_assert(STACK_TRIVIAL<T>, "Elements are stored in a file bytewise, T must be trivially copyable");
+
+    MyAssertSoftResult(path, NULL, ERROR_NULLPTR);
+
+    PersistentStack<T>* stack = (PersistentStack<T>*)calloc(1, sizeof(PersistentStack<T>));
+
+    if (!stack)
+        return {NULL, ERROR_NO_MEMORY};
+
+    stack->origin = *origin;
+    stack->protection = min(protection, STACK_PROTECTION_CANARY);
+    stack->dirtyFrom = SIZET_POISON;
+
+    #ifdef CANARY_PROTECTION
+    stack->leftCanary = _CANARY;
+    stack->rightCanary = _CANARY;
+    #endif
+
+    bool created = false;
+
+    ErrorCode error = _persistentMapFile(path, _PERSISTENT_DATA_OFFSET + DEFAULT_CAPACITY * sizeof(T),
+                                         &stack->fd, &stack->mapping, &stack->mappingSize, &created);
+
+    if (error)
+    {
+        free(stack);
+        return {NULL, error};
+    }
+
+    stack->data = (T*)(stack->mapping + _PERSISTENT_DATA_OFFSET);
+    stack->capacity = _getPersistentCapacity<T>(stack->mappingSize);
+
+    _PersistentHeader* header = (_PersistentHeader*)stack->mapping;
+
+    if (created)
+    {
+        _persistentInitHeader(header, sizeof(T));
+        error = _persistentCommit(header, 0, 0);
+    }
+    else
+    {
+        error = _persistentCheckHeader(header, sizeof(T));
+
+        const _PersistentRecord* record = _persistentLastRecord(header);
+
+        if (!error && !record)
+            error = ERROR_BAD_HASH;
+
+        if (!error && record->committedSize > stack->capacity)
+            error = ERROR_BAD_SIZE;
+
+        if (!error)
+        {
+            hash_t dataHash = 0;
+
+            for (size_t i = 0; i < record->committedSize; i++)
+                dataHash += _persistentSlotHash(i, stack->data[i]);
+
+            if (dataHash != record->dataHash)
+                error = ERROR_BAD_HASH;
+
+            stack->size = record->committedSize;
+            stack->committedSize = record->committedSize;
+            stack->dataHash = dataHash;
+        }
+    }
+
+    if (error)
+    {
+        _persistentUnmapFile(stack->fd, stack->mapping, stack->mappingSize);
+        free(stack);
+
+        return {NULL, error};
+    }
+
+    return {stack, EVERYTHING_FINE};
+}
+
+template <typename T>
+ErrorCode StackDestructor(PersistentStack<T>* stack)
+{
+    ErrorCode error = StackSync(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    _persistentUnmapFile(stack->fd, stack->mapping, stack->mappingSize);
+
+    stack->mapping = NULL;
+    stack->data = NULL;
+    stack->size = SIZET_POISON;
+    stack->origin = {};
+
+    #ifdef CANARY_PROTECTION
+    stack->leftCanary = SIZET_POISON;
+    stack->rightCanary = SIZET_POISON;
+    #endif
+
+    free(stack);
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode CheckStackIntegrity(PersistentStack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    RETURN_ERROR(_checkPersistentStackFast(stack));
+
+    _PersistentHeader* header = (_PersistentHeader*)stack->mapping;
+
+    RETURN_ERROR(_persistentCheckHeader(header, sizeof(T)));
+
+    const _PersistentRecord* record = _persistentLastRecord(header);
+
+    if (!record || record->committedSize != stack->committedSize)
+        return ERROR_BAD_HASH;
+
+    hash_t dataHash = 0;
+
+    for (size_t i = 0; i < stack->size; i++)
+        dataHash += _persistentSlotHash(i, stack->data[i]);
+
+    if (dataHash != stack->dataHash)
+        return ERROR_BAD_HASH;
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+static ErrorCode _checkPersistentStackFast(PersistentStack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    #ifdef CANARY_PROTECTION
+    if (stack->protection >= STACK_PROTECTION_CANARY &&
+        (stack->leftCanary != _CANARY || stack->rightCanary != _CANARY))
+        return ERROR_DEAD_CANARY;
+    #endif
+
+    if (!stack->mapping)
+        return ERROR_NO_MEMORY;
+
+    if (stack->size > stack->capacity || stack->committedSize > stack->capacity)
+        return ERROR_INDEX_OUT_OF_BOUNDS;
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode StackSync(PersistentStack<T>* stack)
+{
+    ErrorCode error = _checkPersistentStackFast(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    if (stack->dirtyFrom < stack->size)
+        RETURN_ERROR(_persistentSyncRange(stack->mapping, _PERSISTENT_DATA_OFFSET + stack->dirtyFrom * sizeof(T),
+                                                          _PERSISTENT_DATA_OFFSET + stack->size * sizeof(T)));
+
+    if (stack->dirtyFrom == SIZET_POISON && stack->committedSize == stack->size)
+        return EVERYTHING_FINE;
+
+    RETURN_ERROR(_persistentCommit((_PersistentHeader*)stack->mapping, stack->size, stack->dataHash));
+
+    stack->committedSize = stack->size;
+    stack->dirtyFrom = SIZET_POISON;
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode Push(PersistentStack<T>* stack, T value)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    if (stack->protection != STACK_PROTECTION_NONE)
+    {
+        ErrorCode error = _checkPersistentStackFast(stack);
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+        RETURN_ERROR(error);
+    }
+
+    if (stack->size == stack->capacity)
+    {
+        size_t newCapacity = _getNewCapacity(stack->size, stack->capacity, &DEFAULT_GROWTH_POLICY);
+
+        ErrorCode error = _persistentGrowFile(stack->fd, &stack->mapping, &stack->mappingSize,
+                                              _PERSISTENT_DATA_OFFSET + newCapacity * sizeof(T));
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+        RETURN_ERROR(error);
+
+        stack->data = (T*)(stack->mapping + _PERSISTENT_DATA_OFFSET);
+        stack->capacity = _getPersistentCapacity<T>(stack->mappingSize);
+    }
+
+    // Don't overwrite a committed element before the commit stops covering it
+    if (stack->size < stack->committedSize)
+    {
+        RETURN_ERROR(_persistentCommit((_PersistentHeader*)stack->mapping, stack->size, stack->dataHash));
+
+        stack->committedSize = stack->size;
+    }
+
+    stack->data[stack->size] = value;
+    stack->dataHash += _persistentSlotHash(stack->size, value);
+
+    stack->dirtyFrom = min(stack->dirtyFrom, stack->size);
+    stack->size++;
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+StackElementResult<T> Pop(PersistentStack<T>* stack)
+{
+    MyAssertSoftResult(stack, _getPoison<T>(), ERROR_NULLPTR);
+
+    if (stack->protection != STACK_PROTECTION_NONE)
+    {
+        ErrorCode error = _checkPersistentStackFast(stack);
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+        if (error)
+            return {_getPoison<T>(), error};
+    }
+
+    if (stack->size == 0)
+        return {_getPoison<T>(), ERROR_INDEX_OUT_OF_BOUNDS};
+
+    // The slot is not poisoned, it may still be committed
+    T value = stack->data[--stack->size];
+    stack->dataHash -= _persistentSlotHash(stack->size, value);
+
+    return {value, EVERYTHING_FINE};
+}
+
+template <typename T>
+ErrorCode _stackDump(FILE* where, PersistentStack<T>* stack, SourceCodePosition* caller, ErrorCode error)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+    MyAssertSoft(caller, ERROR_NULLPTR);
+
+    MyAssertSoft(where, ERROR_BAD_FILE);
+
+    const size_t maxStackValues = 4096;
+
+    fprintf(where, "PersistentStack[%p] from %s(%zu) %s()\n", stack, stack->origin.fileName, stack->origin.line, stack->origin.name);
+    fprintf(where, "called from %s(%zu) %s()\n", caller->fileName, caller->line, caller->name);
+    fprintf(where, "Stack condition - %s\n", ERROR_CODE_NAMES[error]);
+    fprintf(where, "Stack protection - %s\n", STACK_PROTECTION_NAMES[stack->protection]);
+
+    #ifdef CANARY_PROTECTION
+    fprintf(where, "Left stack canary = %zu", stack->leftCanary);
+    if (stack->leftCanary != _CANARY)
+        fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+    fprintf(where, "\n");
+
+    fprintf(where, "Right stack canary = %zu", stack->rightCanary);
+    if (stack->rightCanary != _CANARY)
+        fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+    fprintf(where, "\n");
+    #endif
+
+    fprintf(where, "{\n");
+    fprintf(where, "    size = %zu\n", stack->size);
+    fprintf(where, "    capacity = %zu\n", stack->capacity);
+    fprintf(where, "    committed size = %zu\n", stack->committedSize);
+    fprintf(where, "    data hash = %u\n", stack->dataHash);
+    fprintf(where, "    mapping[%p] of %zu bytes\n", stack->mapping, stack->mappingSize);
+
+    if (stack->mapping)
+    {
+        const _PersistentHeader* header = (const _PersistentHeader*)stack->mapping;
+
+        for (size_t i = 0; i < 2; i++)
+            fprintf(where, "    record %zu = {sequence = %llu, committed size = %zu, data hash = %u}\n", i,
+                    (unsigned long long)header->records[i].sequence, header->records[i].committedSize,
+                    header->records[i].dataHash);
+
+        size_t numOfElements = min(stack->size, maxStackValues);
+
+        for (size_t i = 0; i < numOfElements; i++)
+        {
+            fprintf(where, "    *[%zu] = ", i);
+            StackTraits<T>::Print(where, stack->data[i]);
+            fprintf(where, "\n");
+        }
+    }
+
+    fprintf(where, "}\n\n\n");
+
+    return EVERYTHING_FINE;
+}
+
+#endif
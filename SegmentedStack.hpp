@@ -0,0 +1,475 @@
+//! @file
+
+#ifndef SEGMENTED_STACK_HPP
+#define SEGMENTED_STACK_HPP
+
+#include "Stack.hpp"
+
+/**
+ * @brief Stack of T stored in a linked list of fixed size chunks.
+ *
+ * Growth allocates a new chunk and never copies the elements, so Push and Pop
+ * are O(1) in the worst case and the peak memory is the size plus one chunk.
+ * The last freed chunk is kept as a spare, so pushing and popping around
+ * a chunk boundary does not allocate.
+ *
+ * Each chunk has its own canaries, Push and Pop check the top chunk only,
+ * @see CheckStackIntegrity checks all of them. Protection is at most @see STACK_PROTECTION_CANARY.
+*/
+template <typename T>
+struct SegmentedStack;
+
+/**
+ * @brief Struct that @see SegmentedStackInit returns. If error is not 0, then value = NULL.
+ *
+ * @var SegmentedStackResult::value - pointer to the stack.
+ * @var SegmentedStackResult::error - error message @see ErrorCode.
+*/
+template <typename T>
+struct SegmentedStackResult
+{
+    SegmentedStack<T>* value;
+    ErrorCode error;
+};
+
+/**
+ * @brief Initializes a segmented stack.
+ *
+ * @param [in] type - element type.
+ * @param [in] protection - optional @see StackProtection, @see DEFAULT_PROTECTION if omitted.
+ * @param [in] arena - optional @see StackArena to allocate the chunks from.
+ *
+ * @return SegmentedStackResult<type>.
+*/
+#define SegmentedStackInit(type, ...)                                                    \
+({                                                                                       \
+    SourceCodePosition _owner = {__FILE__, __LINE__, __func__};                          \
+    _segmentedStackInit<type>(&_owner, ##__VA_ARGS__);                                   \
+})
+
+template <typename T>
+SegmentedStackResult<T> _segmentedStackInit(SourceCodePosition* owner, StackProtection protection = DEFAULT_PROTECTION,
+                                            StackArena* arena = NULL);
+
+/**
+ * @brief Destroys the stack, its elements and chunks.
+ *
+ * @param [in] stack - the stack to destroy.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode StackDestructor(SegmentedStack<T>* stack);
+
+/**
+ * @brief Checks the stack and every chunk.
+ *
+ * @param [in] stack - the stack to check.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode CheckStackIntegrity(SegmentedStack<T>* stack);
+
+/**
+ * @brief Moves an element on top of the stack.
+ *
+ * @param [in] stack - the stack.
+ * @param [in] value - the value.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode Push(SegmentedStack<T>* stack, T value);
+
+/**
+ * @brief Removes the top element and moves it out.
+ *
+ * @param [in] stack - the stack.
+ *
+ * @return @see StackElementResult, ERROR_INDEX_OUT_OF_BOUNDS if the stack is empty.
+*/
+template <typename T>
+StackElementResult<T> Pop(SegmentedStack<T>* stack);
+
+template <typename T>
+ErrorCode _stackDump(FILE* where, SegmentedStack<T>* stack, SourceCodePosition* caller, ErrorCode error);
+
+/**
+ * @brief Chunk header, followed by a canary, data, canary buffer of @see _getChunkCapacity elements.
+*/
+template <typename T>
+struct _StackChunk
+{
+    _StackChunk* prev;
+    T* data;
+};
+
+template <typename T>
+struct SegmentedStack
+{
+    #ifdef CANARY_PROTECTION
+    canary_t leftCanary;
+    #endif
+
+    SourceCodePosition origin;
+    StackProtection protection;
+    StackArena* arena;
+
+    size_t size;
+    size_t chunksCount;
+
+    _StackChunk<T>* top;
+    size_t topSize;
+
+    _StackChunk<T>* spare;
+
+    #ifdef CANARY_PROTECTION
+    canary_t rightCanary;
+    #endif
+};
+
+/**
+ * @brief Offset of the chunk buffer from the chunk header.
+*/
+template <typename T>
+static constexpr size_t _getChunkHeaderSize()
+{
+    size_t alignment = alignof(T) > alignof(canary_t) ? alignof(T) : alignof(canary_t);
+
+    return (sizeof(_StackChunk<T>) + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * @brief Number of elements in a chunk of about STACK_CHUNK_SIZE bytes, at least one.
+*/
+template <typename T>
+static constexpr size_t _getChunkCapacity()
+{
+    size_t overhead = _getChunkHeaderSize<T>() + _getRealDataSize<T>(0);
+
+    return STACK_CHUNK_SIZE > overhead + sizeof(T) ? (STACK_CHUNK_SIZE - overhead) / sizeof(T) : 1;
+}
+
+template <typename T>
+static constexpr size_t _getChunkSize()
+{
+    return _getChunkHeaderSize<T>() + _getRealDataSize<T>(_getChunkCapacity<T>());
+}
+
+template <typename T>
+static _StackChunk<T>* _chunkCreate(SegmentedStack<T>* stack);
+
+template <typename T>
+static void _chunkFree(SegmentedStack<T>* stack, _StackChunk<T>* chunk);
+
+template <typename T>
+static ErrorCode _checkChunk(const _StackChunk<T>* chunk);
+
+template <typename T>
+static ErrorCode _checkSegmentedStackFast(SegmentedStack<T>* stack);
+
+template <typename T>
+SegmentedStackResult<T> _segmentedStackInit(SourceCodePosition* origin, StackProtection protection, StackArena* arena)
+{
+    SegmentedStack<T>* stack = (SegmentedStack<T>*)_stackMemAlloc(arena, sizeof(SegmentedStack<T>));
+
+    if (!stack)
+        return {NULL, ERROR_NO_MEMORY};
+
+    *stack = {};
+
+    stack->origin = *origin;
+    stack->protection = min(protection, STACK_PROTECTION_CANARY);
+    stack->arena = arena;
+
+    #ifdef CANARY_PROTECTION
+    stack->leftCanary = _CANARY;
+    stack->rightCanary = _CANARY;
+    #endif
+
+    return {stack, EVERYTHING_FINE};
+}
+
+template <typename T>
+ErrorCode StackDestructor(SegmentedStack<T>* stack)
+{
+    ErrorCode error = CheckStackIntegrity(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    _StackChunk<T>* chunk = stack->top;
+    size_t chunkSize = stack->topSize;
+
+    while (chunk)
+    {
+        _StackChunk<T>* prev = chunk->prev;
+
+        if constexpr (!STACK_TRIVIAL<T>)
+            for (size_t i = 0; i < chunkSize; i++)
+                chunk->data[i].~T();
+
+        _chunkFree(stack, chunk);
+
+        chunk = prev;
+        chunkSize = _getChunkCapacity<T>();
+    }
+
+    if (stack->spare)
+        _chunkFree(stack, stack->spare);
+
+    stack->top = NULL;
+    stack->spare = NULL;
+    stack->size = SIZET_POISON;
+    stack->topSize = SIZET_POISON;
+    stack->origin = {};
+
+    #ifdef CANARY_PROTECTION
+    stack->leftCanary = SIZET_POISON;
+    stack->rightCanary = SIZET_POISON;
+    #endif
+
+    _stackMemFree(stack->arena, stack, sizeof(SegmentedStack<T>));
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode CheckStackIntegrity(SegmentedStack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    RETURN_ERROR(_checkSegmentedStackFast(stack));
+
+    size_t chunksCount = 0;
+
+    for (_StackChunk<T>* chunk = stack->top; chunk; chunk = chunk->prev)
+    {
+        if (stack->protection >= STACK_PROTECTION_CANARY)
+            RETURN_ERROR(_checkChunk(chunk));
+
+        chunksCount++;
+    }
+
+    if (chunksCount != stack->chunksCount)
+        return ERROR_BAD_VALUE;
+
+    if (stack->spare && stack->protection >= STACK_PROTECTION_CANARY)
+        RETURN_ERROR(_checkChunk(stack->spare));
+
+    return EVERYTHING_FINE;
+}
+
+/**
+ * @brief Checks the stack header and the top chunk in O(1).
+*/
+template <typename T>
+static ErrorCode _checkSegmentedStackFast(SegmentedStack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    #ifdef CANARY_PROTECTION
+    if (stack->protection >= STACK_PROTECTION_CANARY &&
+        (stack->leftCanary != _CANARY || stack->rightCanary != _CANARY))
+        return ERROR_DEAD_CANARY;
+    #endif
+
+    if (stack->topSize > _getChunkCapacity<T>() ||
+        stack->size != (stack->chunksCount ? (stack->chunksCount - 1) * _getChunkCapacity<T>() : 0) + stack->topSize)
+        return ERROR_INDEX_OUT_OF_BOUNDS;
+
+    if (stack->top && stack->protection >= STACK_PROTECTION_CANARY)
+        RETURN_ERROR(_checkChunk(stack->top));
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode Push(SegmentedStack<T>* stack, T value)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    if (stack->protection != STACK_PROTECTION_NONE)
+    {
+        ErrorCode error = _checkSegmentedStackFast(stack);
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+        RETURN_ERROR(error);
+    }
+
+    if (!stack->top || stack->topSize == _getChunkCapacity<T>())
+    {
+        _StackChunk<T>* chunk = stack->spare;
+
+        if (chunk)
+            stack->spare = NULL;
+        else
+            chunk = _chunkCreate(stack);
+
+        if (!chunk)
+        {
+            _STACK_DUMP_ERROR_DEBUG(stack, ERROR_NO_MEMORY);
+            return ERROR_NO_MEMORY;
+        }
+
+        chunk->prev = stack->top;
+
+        stack->top = chunk;
+        stack->topSize = 0;
+        stack->chunksCount++;
+    }
+
+    _storeSlot(&stack->top->data[stack->topSize++], std::move(value));
+    stack->size++;
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+StackElementResult<T> Pop(SegmentedStack<T>* stack)
+{
+    MyAssertSoftResult(stack, _getPoison<T>(), ERROR_NULLPTR);
+
+    if (stack->protection != STACK_PROTECTION_NONE)
+    {
+        ErrorCode error = _checkSegmentedStackFast(stack);
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+        if (error)
+            return {_getPoison<T>(), error};
+    }
+
+    if (stack->size == 0)
+        return {_getPoison<T>(), ERROR_INDEX_OUT_OF_BOUNDS};
+
+    T value = _takeSlot(&stack->top->data[--stack->topSize]);
+    stack->size--;
+
+    if (stack->topSize == 0)
+    {
+        _StackChunk<T>* chunk = stack->top;
+
+        stack->top = chunk->prev;
+        stack->topSize = stack->top ? _getChunkCapacity<T>() : 0;
+        stack->chunksCount--;
+
+        if (stack->spare)
+            _chunkFree(stack, stack->spare);
+
+        stack->spare = chunk;
+    }
+
+    return {std::move(value), EVERYTHING_FINE};
+}
+
+template <typename T>
+ErrorCode _stackDump(FILE* where, SegmentedStack<T>* stack, SourceCodePosition* caller, ErrorCode error)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+    MyAssertSoft(caller, ERROR_NULLPTR);
+
+    MyAssertSoft(where, ERROR_BAD_FILE);
+
+    const size_t maxStackValues = 4096;
+
+    fprintf(where, "SegmentedStack[%p] from %s(%zu) %s()\n", stack, stack->origin.fileName, stack->origin.line, stack->origin.name);
+    fprintf(where, "called from %s(%zu) %s()\n", caller->fileName, caller->line, caller->name);
+    fprintf(where, "Stack condition - %s\n", ERROR_CODE_NAMES[error]);
+    fprintf(where, "Stack protection - %s\n", STACK_PROTECTION_NAMES[stack->protection]);
+
+    #ifdef CANARY_PROTECTION
+    fprintf(where, "Left stack canary = %zu", stack->leftCanary);
+    if (stack->leftCanary != _CANARY)
+        fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+    fprintf(where, "\n");
+
+    fprintf(where, "Right stack canary = %zu", stack->rightCanary);
+    if (stack->rightCanary != _CANARY)
+        fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+    fprintf(where, "\n");
+    #endif
+
+    fprintf(where, "{\n");
+    fprintf(where, "    size = %zu\n", stack->size);
+    fprintf(where, "    chunks = %zu of %zu elements\n", stack->chunksCount, _getChunkCapacity<T>());
+    fprintf(where, "    spare chunk[%p]\n", stack->spare);
+
+    size_t printed = 0;
+    size_t chunkSize = stack->topSize;
+
+    for (_StackChunk<T>* chunk = stack->top; chunk && printed < maxStackValues; chunk = chunk->prev)
+    {
+        fprintf(where, "    chunk[%p]\n", chunk);
+
+        #ifdef CANARY_PROTECTION
+        canary_t leftChunkCanary  = *_getLeftDataCanaryPtr(chunk->data);
+        canary_t rightChunkCanary = *_getRightDataCanaryPtr(chunk->data, _getRealDataSize<T>(_getChunkCapacity<T>()));
+
+        fprintf(where, "    Left chunk canary = %zu", leftChunkCanary);
+        if (leftChunkCanary != _CANARY)
+            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+        fprintf(where, "\n");
+
+        fprintf(where, "    Right chunk canary = %zu", rightChunkCanary);
+        if (rightChunkCanary != _CANARY)
+            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+        fprintf(where, "\n");
+        #endif
+
+        for (size_t i = chunkSize; i > 0 && printed < maxStackValues; i--, printed++)
+        {
+            fprintf(where, "        *[%zu] = ", i - 1);
+            StackTraits<T>::Print(where, chunk->data[i - 1]);
+            fprintf(where, "\n");
+        }
+
+        chunkSize = _getChunkCapacity<T>();
+    }
+
+    fprintf(where, "}\n\n\n");
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+static _StackChunk<T>* _chunkCreate(SegmentedStack<T>* stack)
+{
+    char* memory = (char*)_stackMemAlloc(stack->arena, _getChunkSize<T>());
+
+    if (!memory)
+        return NULL;
+
+    _StackChunk<T>* chunk = (_StackChunk<T>*)memory;
+
+    chunk->prev = NULL;
+    chunk->data = (T*)(memory + _getChunkHeaderSize<T>() + _getDataOffset<T>());
+
+    #ifdef CANARY_PROTECTION
+    *_getLeftDataCanaryPtr(chunk->data) = _CANARY;
+    *_getRightDataCanaryPtr(chunk->data, _getRealDataSize<T>(_getChunkCapacity<T>())) = _CANARY;
+    #endif
+
+    return chunk;
+}
+
+template <typename T>
+static void _chunkFree(SegmentedStack<T>* stack, _StackChunk<T>* chunk)
+{
+    _stackMemFree(stack->arena, chunk, _getChunkSize<T>());
+}
+
+template <typename T>
+static ErrorCode _checkChunk(const _StackChunk<T>* chunk)
+{
+    #ifdef CANARY_PROTECTION
+    if (*_getLeftDataCanaryPtr(chunk->data) != _CANARY ||
+        *_getRightDataCanaryPtr(chunk->data, _getRealDataSize<T>(_getChunkCapacity<T>())) != _CANARY)
+        return ERROR_DEAD_CANARY;
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+#endif
@@ -1,14 +1,14 @@
 #include <time.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "Stack.hpp"
-#include "MinMax.hpp"
-
-typedef unsigned int hash_t;
-
-static const hash_t HASH_SEED = 0xBEBDA;
 
 static FILE* _getLogFile()
 {
-    FILE* _logFile = fopen(logFilePath, "w");
+    int logFd = open(logFilePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    FILE* _logFile = logFd >= 0 ? _logOpen(logFd) : NULL;
     
     if (!_logFile)
     {
@@ -16,25 +16,60 @@ static FILE* _getLogFile()
         fprintf(stderr, "ERROR!!! COULDN'T OPEN LOG FILE!!!!\n");
         SetConsoleColor(stderr, COLOR_WHITE);
 
+        if (logFd >= 0)
+            close(logFd);
+
         return NULL;
     }
 
-    setvbuf(_logFile, NULL, _IONBF, 0);
+    setvbuf(_logFile, NULL, _IOFBF, STACK_LOG_STREAM_BUFFER_SIZE);
 
     return _logFile;
 }
 
-static FILE* LOG_FILE = _getLogFile();
+FILE* LOG_FILE = _getLogFile();
 
-#define _STACK_DUMP_ERROR_DEBUG(stack, error)                                            \
-do                                                                                       \
-{                                                                                        \
-    if (error && stack && LOG_FILE)                                                      \
-    {                                                                                    \
-        SourceCodePosition _caller = {__FILE__, __LINE__, __func__};                     \
-        _stackDump(LOG_FILE, stack, &_caller, error);                                    \
-    }                                                                                    \
-} while (0);
+StackDumpFormat _DUMP_FORMAT = DEFAULT_DUMP_FORMAT;
+
+void StackSetDumpFormat(StackDumpFormat format)
+{
+    __atomic_store_n(&_DUMP_FORMAT, format, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Registered stack and the last error reported for it.
+ *
+ * The element type is erased, audit and dump are instantiated for it on registration.
+*/
+struct _AuditEntry
+{
+    void* stack;
+    _AuditFunction audit;
+    _DumpFunction dump;
+    ErrorCode lastError;
+};
+
+/**
+ * @brief Background auditor state, guarded by @see _AUDIT_MUTEX.
+*/
+struct _Auditor
+{
+    _AuditEntry* entries;
+    size_t size;
+    size_t capacity;
+
+    StackAuditCallback callback;
+    void* context;
+    uint64_t periodNs;
+
+    pthread_t thread;
+    pthread_cond_t wakeUp;
+    bool running;
+};
+
+pthread_mutex_t _AUDIT_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+
+static _Auditor _AUDITOR = { .wakeUp = PTHREAD_COND_INITIALIZER };
 
 #ifdef CANARY_PROTECTION
     static canary_t _getRandomCanary()
@@ -52,474 +87,179 @@ do
         return _tCnry.canary;
     }
 
-    static const size_t _CANARY = _getRandomCanary();
+    const canary_t _CANARY = _getRandomCanary();
 #endif
 
-struct Stack
-{
-    #ifdef CANARY_PROTECTION
-    canary_t leftCanary;
-    #endif
-
-    size_t realDataSize;
-    StackElement_t* data;
-
-    SourceCodePosition origin;
-    size_t size;
-    size_t capacity;
-
-    #ifdef HASH_PROTECTION
-    hash_t hashData;
-    hash_t hashStack;
-    #endif
-
-    #ifdef CANARY_PROTECTION
-    canary_t rightCanary;
-    #endif
-};
-
-#ifdef CANARY_PROTECTION
-static ErrorCode _checkCanary(const Stack* stack);
+static void _auditPass();
 
-static canary_t* _getLeftDataCanaryPtr(const StackElement_t* data);
+static void* _auditThread(void*);
 
-static canary_t* _getRightDataCanaryPtr(const StackElement_t* data, size_t realDataSize);
-#endif
-
-#ifdef HASH_PROTECTION
-static ErrorCode _checkHash(Stack* stack);
-
-static ErrorCode _reHashify(Stack* stack);
-
-static hash_t _calculateDataHash(const Stack* stack);
-
-static hash_t _calculateStackHash(Stack* stack);
-#endif
-
-static ErrorCode _stackRealloc(Stack* stack);
-
-StackResult _stackInit(SourceCodePosition* origin)
+ErrorCode StackAuditStart(uint64_t periodNs, StackAuditCallback callback, void* context)
 {
-    Stack* stack = (Stack*)calloc(1, sizeof(Stack));
-
-    if (!stack)
-        return {NULL, ERROR_NO_MEMORY};
+    pthread_mutex_lock(&_AUDIT_MUTEX);
 
-    *stack = 
+    if (_AUDITOR.running)
     {
-        #ifdef CANARY_PROTECTION
-            .leftCanary = _CANARY,
-        #endif
-        .origin = *origin,
-        .size = 0,
-        .capacity = DEFAULT_CAPACITY
-        #ifdef CANARY_PROTECTION
-            ,.rightCanary = _CANARY
-        #endif
-    };
-
-    size_t realDataSize = DEFAULT_CAPACITY * sizeof(StackElement_t);
-
-    #ifdef CANARY_PROTECTION
-    realDataSize += 2 * sizeof(canary_t);
-    #endif
+        pthread_mutex_unlock(&_AUDIT_MUTEX);
+        return ERROR_BAD_VALUE;
+    }
 
-    StackElement_t* data = (StackElement_t*)calloc(realDataSize, 1);
+    _AUDITOR.periodNs = periodNs ? periodNs : DEFAULT_AUDIT_PERIOD_NS;
+    _AUDITOR.callback = callback;
+    _AUDITOR.context  = context;
+    _AUDITOR.running  = true;
 
     ErrorCode error = EVERYTHING_FINE;
-    if (!data)
-    {
-        error = ERROR_NO_MEMORY;
-        stack->capacity = 0;
-        realDataSize = 0;
-    }
 
-    #ifdef CANARY_PROTECTION
-    if (data)
-        data = (StackElement_t*)((void*)data + sizeof(canary_t));
-    #endif
-
-    #ifdef CANARY_PROTECTION
-    if (data)
+    if (pthread_create(&_AUDITOR.thread, NULL, _auditThread, NULL) != 0)
     {
-        *_getLeftDataCanaryPtr(data) = _CANARY;
-        *_getRightDataCanaryPtr(data, realDataSize) = _CANARY;
+        _AUDITOR.running = false;
+        error = ERROR_NO_MEMORY;
     }
-    #endif
 
-    for (size_t i = 0; i < stack->capacity; i++)
-        data[i] = POISON;
-    
-    stack->data = data;
-    stack->realDataSize = realDataSize;
-
-    #ifdef HASH_PROTECTION
-    _reHashify(stack);
-    #endif
+    pthread_mutex_unlock(&_AUDIT_MUTEX);
 
-    return {stack, error};
+    return error;
 }
 
-ErrorCode StackDestructor(Stack* stack)
+ErrorCode StackAuditStop()
 {
-    ErrorCode error = CheckStackIntegrity(stack);
-
-    _STACK_DUMP_ERROR_DEBUG(stack, error);
-    RETURN_ERROR(error);
-
-    if (stack->data == NULL)
-        error = ERROR_NO_MEMORY;
-    else
-        #ifdef CANARY_PROTECTION
-        free((void*)stack->data - sizeof(canary_t));
-        #else
-        free((void*)stack->data);
-        #endif
-
-    stack->size = POISON;
-    stack->capacity = POISON;
-
-    stack->data = NULL;
+    pthread_mutex_lock(&_AUDIT_MUTEX);
 
-    stack->origin = {};
-
-    #ifdef HASH_PROTECTION
-        stack->hashData = POISON;
-        stack->hashStack = POISON;
-    #endif
+    if (!_AUDITOR.running)
+    {
+        pthread_mutex_unlock(&_AUDIT_MUTEX);
+        return EVERYTHING_FINE;
+    }
 
-    #ifdef CANARY_PROTECTION
-        stack->leftCanary = POISON;
-        stack->rightCanary = POISON;
-    #endif
-    
-    free((void*)stack);
+    _AUDITOR.running = false;
+    pthread_cond_signal(&_AUDITOR.wakeUp);
 
-    return error;
-}
+    pthread_mutex_unlock(&_AUDIT_MUTEX);
 
-ErrorCode CheckStackIntegrity(Stack* stack)
-{
-    MyAssertSoft(stack, ERROR_NULLPTR);
+    pthread_join(_AUDITOR.thread, NULL);
 
-    if (stack->capacity < stack->size)
-        return ERROR_INDEX_OUT_OF_BOUNDS;
-    if (!stack->data)
-        return ERROR_NO_MEMORY;
-    
-    #ifdef CANARY_PROTECTION
-        ErrorCode canaryError = _checkCanary(stack);
-        _STACK_DUMP_ERROR_DEBUG(stack, canaryError);
-        RETURN_ERROR(canaryError);
-    #endif
-
-    #ifdef HASH_PROTECTION
-        ErrorCode error = _checkHash(stack);
-        _STACK_DUMP_ERROR_DEBUG(stack, error);
-        RETURN_ERROR(error);
-    #endif
-    
     return EVERYTHING_FINE;
 }
 
-ErrorCode _stackDump(FILE* where, Stack* stack, SourceCodePosition* caller, ErrorCode error)
+ErrorCode StackAuditRun()
 {
-    MyAssertSoft(stack, ERROR_NULLPTR);
-    MyAssertSoft(caller, ERROR_NULLPTR);
-
-    MyAssertSoft(where, ERROR_BAD_FILE);
-
-    const size_t maxStackValues = 4096;
-
-    fprintf(where, "Stack[%p] from %s(%zu) %s()\n", stack, stack->origin.fileName, stack->origin.line, stack->origin.name);
-    fprintf(where, "called from %s(%zu) %s()\n", caller->fileName, caller->line, caller->name);
-    fprintf(where, "Stack condition - %s\n", ERROR_CODE_NAMES[error]);
-
-    #ifdef HASH_PROTECTION
-        uint dataHash  = _calculateDataHash(stack);
-        uint stackHash = _calculateStackHash(stack);
-
-        fprintf(where, "Data hash = %u", stack->hashData);
-        if (stack->hashData != dataHash)
-            fprintf(where, " INVALID!!! SHOULD BE %u", dataHash);
-        fprintf(where, "\n");
-
-        fprintf(where, "Stack hash = %u", stack->hashStack);
-        if (stack->hashStack != stackHash)
-            fprintf(where, " INVALID!!! SHOULD BE %u", stackHash);
-        fprintf(where, "\n");
-    #endif
-
-    #ifdef CANARY_PROTECTION
-        fprintf(where, "Left stack canary = %zu", stack->leftCanary);
-        if (stack->leftCanary != _CANARY)
-            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
-        fprintf(where, "\n");
-
-        fprintf(where, "Right stack canary = %zu", stack->rightCanary);
-        if (stack->rightCanary != _CANARY)
-            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
-        fprintf(where, "\n");
-    #endif
-
-    fprintf(where, "{\n");
-    fprintf(where, "    size = %zu\n", stack->size);
-    fprintf(where, "    capacity = %zu\n", stack->capacity);
-    fprintf(where, "    data[%p]\n", stack->data);
-
-    #ifdef CANARY_PROTECTION
-        canary_t leftDataCanary = *_getLeftDataCanaryPtr(stack->data);
-        fprintf(where, "    Left data canary = %zu", leftDataCanary);
-        if (leftDataCanary != _CANARY)
-            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
-        fprintf(where, "\n");
-    #endif
-
-    const StackElement_t* data = stack->data;
-    size_t numOfElements = min(stack->capacity, maxStackValues);
-
-    for (size_t i = 0; i < numOfElements; i++)
-    {
-        fprintf(where, "    ");
-
-        if (data[i] != POISON)
-            fprintf(where, "*[%zu] = " STACK_EL_SPECIFIER "\n", i, data[i]);
-        else
-            fprintf(where, " [%zu] = POISON\n", i);
-    }
-
-    #ifdef CANARY_PROTECTION
-        canary_t rightDataCanary = *_getRightDataCanaryPtr(stack->data, stack->realDataSize);
-        fprintf(where, "    Right data canary = %zu", rightDataCanary);
-        if (leftDataCanary != _CANARY)
-            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
-        fprintf(where, "\n");
-    #endif
-
-    fprintf(where, "}\n\n\n");
+    _auditPass();
 
     return EVERYTHING_FINE;
 }
 
-ErrorCode Push(Stack* stack, StackElement_t value)
+ErrorCode _auditAdd(void* stack, _AuditFunction audit, _DumpFunction dump)
 {
-    ErrorCode error = CheckStackIntegrity(stack);
-
-    _STACK_DUMP_ERROR_DEBUG(stack, error);
-    RETURN_ERROR(error);
-
-    error = _stackRealloc(stack);
+    if (_AUDITOR.size == _AUDITOR.capacity)
+    {
+        size_t newCapacity = _AUDITOR.capacity ? _AUDITOR.capacity * STACK_GROW_FACTOR : DEFAULT_CAPACITY;
 
-    _STACK_DUMP_ERROR_DEBUG(stack, error);
-    RETURN_ERROR(error);
+        _AuditEntry* newEntries = (_AuditEntry*)realloc(_AUDITOR.entries, newCapacity * sizeof(_AuditEntry));
 
-    stack->data[stack->size++] = value;
+        if (!newEntries)
+            return ERROR_NO_MEMORY;
 
-    #ifdef CANARY_PROTECTION
-        ErrorCode canaryError = _checkCanary(stack);
-        _STACK_DUMP_ERROR_DEBUG(stack, canaryError);
-        RETURN_ERROR(canaryError);
-    #endif
+        _AUDITOR.entries  = newEntries;
+        _AUDITOR.capacity = newCapacity;
+    }
 
-    #ifdef HASH_PROTECTION
-    // _reHashify(stack);
-    #endif
+    _AUDITOR.entries[_AUDITOR.size++] = {stack, audit, dump, EVERYTHING_FINE};
 
     return EVERYTHING_FINE;
 }
 
-StackElementResult Pop(Stack* stack)
+ErrorCode _auditRemove(void* stack)
 {
-    ErrorCode error = CheckStackIntegrity(stack);
-
-    _STACK_DUMP_ERROR_DEBUG(stack, error);
-
-    if (error)
-        return {POISON, error};
-
-    if (stack->size == 0)
-        return {POISON, ERROR_INDEX_OUT_OF_BOUNDS};
-
-    stack->size--;
-
-    StackElement_t value = stack->data[stack->size];
-    
-    stack->data[stack->size] = POISON;
-
-    error = _stackRealloc(stack);
-
-    _STACK_DUMP_ERROR_DEBUG(stack, error);
-    if (error)
-        return {value, error};
+    for (size_t i = 0; i < _AUDITOR.size; i++)
+    {
+        if (_AUDITOR.entries[i].stack != stack)
+            continue;
 
-    #ifdef CANARY_PROTECTION
-        ErrorCode canaryError = _checkCanary(stack);
-        _STACK_DUMP_ERROR_DEBUG(stack, canaryError);
-        if (canaryError)
-            return {POISON, canaryError};
-    #endif
+        _AUDITOR.entries[i] = _AUDITOR.entries[--_AUDITOR.size];
 
-    #ifdef HASH_PROTECTION
-    error = _reHashify(stack);
-    #endif
+        return EVERYTHING_FINE;
+    }
 
-    return {value, error};
+    return ERROR_NOT_FOUND;
 }
 
 /**
- * @brief Performs stack reallocation if needed.
- * 
- * It increases stack's size if @see STACK_GROW_FACTOR if stack.size == stack.capacity.
- * It shrinks the stack if stack.size <= stack.capacity in @see STACK_GROW_FACTOR ** 2.
- * Otherwise it does nothing.
+ * @brief Audits every registered stack once, must be called without @see _AUDIT_MUTEX.
  * 
- * @param [in] stack - to resize.
- * 
- * @return @see ErrorCode.
+ * The mutex is held for one stack at a time, so a resize or a registration waits for
+ * a single audit, not the whole pass. A stack unregistered meanwhile may move another
+ * one into a passed slot, which is then audited on the next pass.
+ * Each error is reported once, until the stack state changes.
 */
-static ErrorCode _stackRealloc(Stack* stack)
+static void _auditPass()
 {
-    MyAssertSoft(stack, ERROR_NULLPTR);
-
-    size_t newCapacity = 0;
-
-    if (stack->size == stack->capacity)
-        newCapacity = stack->capacity * STACK_GROW_FACTOR;
-    else if (DEFAULT_CAPACITY < stack->capacity && stack->size <= stack->capacity / (STACK_GROW_FACTOR * STACK_GROW_FACTOR))
-        newCapacity = stack->capacity / (STACK_GROW_FACTOR * STACK_GROW_FACTOR);
-
-    if (newCapacity != 0)
+    for (size_t i = 0; ; i++)
     {
-        StackElement_t* oldData = stack->data;
-        size_t newDataSize = newCapacity * sizeof(StackElement_t);
+        pthread_mutex_lock(&_AUDIT_MUTEX);
 
-        #ifdef CANARY_PROTECTION
-            oldData = (StackElement_t*)((void*)oldData - sizeof(canary_t));
-            newDataSize += 2 * sizeof(canary_t);
-
-            canary_t* oldRightCanaryPtr = _getRightDataCanaryPtr(stack->data, stack->realDataSize);
-            canary_t  oldRightCanary    = *oldRightCanaryPtr;
+        if (i >= _AUDITOR.size)
+        {
+            pthread_mutex_unlock(&_AUDIT_MUTEX);
+            break;
+        }
 
-            *oldRightCanaryPtr = 0;
-        #endif
+        _AuditEntry* entry = &_AUDITOR.entries[i];
 
-        StackElement_t* newData = (StackElement_t*)realloc((void*)oldData, newDataSize);
+        ErrorCode error = entry->audit(entry->stack);
 
-        if (newData == NULL)
+        if (error && error != entry->lastError)
         {
-            _STACK_DUMP_ERROR_DEBUG(stack, ERROR_NO_MEMORY);
-            
-            #ifdef CANARY_PROTECTION
-            *oldRightCanaryPtr = oldRightCanary;
-            #endif
-
-            return ERROR_NO_MEMORY;
+            if (_AUDITOR.callback)
+                _AUDITOR.callback(entry->stack, error, _AUDITOR.context);
+            else if (LOG_FILE)
+            {
+                SourceCodePosition caller = {__FILE__, __LINE__, __func__};
+                entry->dump(LOG_FILE, entry->stack, &caller, error);
+                fflush(LOG_FILE);
+            }
         }
 
-        #ifdef CANARY_PROTECTION
-        newData = (StackElement_t*)((void*)newData + sizeof(canary_t));
-        #endif
-
-        #ifdef CANARY_PROTECTION
-        *_getRightDataCanaryPtr(newData, newDataSize) = oldRightCanary;
-        #endif
+        entry->lastError = error;
 
-        stack->data = newData;
-        stack->realDataSize = newDataSize;
-        stack->capacity = newCapacity;
-
-        for (size_t i = stack->size; i < stack->capacity; i++)
-            newData[i] = POISON;
+        pthread_mutex_unlock(&_AUDIT_MUTEX);
     }
-
-    #ifdef CANARY_PROTECTION
-        ErrorCode canaryError = _checkCanary(stack);
-        _STACK_DUMP_ERROR_DEBUG(stack, canaryError);
-        RETURN_ERROR(canaryError);
-    #endif
-
-    return EVERYTHING_FINE;
 }
 
-#ifdef CANARY_PROTECTION
-static ErrorCode _checkCanary(const Stack* stack)
+static void* _auditThread(void*)
 {
-    MyAssertSoft(stack, ERROR_NULLPTR);
+    pthread_mutex_lock(&_AUDIT_MUTEX);
 
-    if (stack->leftCanary != _CANARY ||
-        stack->rightCanary != _CANARY ||       
-        *_getLeftDataCanaryPtr(stack->data) != _CANARY ||
-        *_getRightDataCanaryPtr(stack->data, stack->realDataSize) != _CANARY)
+    while (_AUDITOR.running)
     {
-        return ERROR_DEAD_CANARY;
-    }
-    
-    return EVERYTHING_FINE;
-}
-
-static canary_t* _getLeftDataCanaryPtr(const StackElement_t* data)
-{
-    return (canary_t*)((void*)data - sizeof(canary_t));
-}
-
-static canary_t* _getRightDataCanaryPtr(const StackElement_t* data, size_t realDataSize)
-{
-    return (canary_t*)((void*)data + realDataSize - 2 * sizeof(canary_t));
-}
-#endif
+        pthread_mutex_unlock(&_AUDIT_MUTEX);
 
-#ifdef HASH_PROTECTION
-static ErrorCode _reHashify(Stack* stack)
-{
-    MyAssertSoft(stack, ERROR_NULLPTR);
-
-    hash_t hashData = _calculateDataHash(stack);
-    hash_t hashStack = _calculateStackHash(stack);
-
-    stack->hashData = hashData;
-    stack->hashStack = hashStack;
-
-    return EVERYTHING_FINE;
-}
-
-static hash_t _calculateDataHash(const Stack* stack)
-{
-    MyAssertSoft(stack, ERROR_NULLPTR);
+        _auditPass();
 
-    const void* data = (const void*)stack->data;
+        pthread_mutex_lock(&_AUDIT_MUTEX);
 
-    #ifdef CANARY_PROTECTION
-    data -= sizeof(canary_t);
-    #endif
+        if (!_AUDITOR.running)
+            break;
 
-    return CalculateHash(data, stack->realDataSize, HASH_SEED);
-}
-
-static hash_t _calculateStackHash(Stack* stack)
-{
-    MyAssertSoft(stack, ERROR_NULLPTR);
-
-    hash_t oldHashData = stack->hashData;
-    hash_t oldHashStack = stack->hashStack;
+        timespec deadline = {};
+        clock_gettime(CLOCK_REALTIME, &deadline);
 
-    stack->hashData = 0;
-    stack->hashStack = 0;
+        uint64_t nsec = (uint64_t)deadline.tv_nsec + _AUDITOR.periodNs;
+        deadline.tv_sec  += (time_t)(nsec / 1000000000);
+        deadline.tv_nsec  = (long)(nsec % 1000000000);
 
-    hash_t stackHash = CalculateHash((const void*)stack, sizeof(*stack), HASH_SEED);
+        pthread_cond_timedwait(&_AUDITOR.wakeUp, &_AUDIT_MUTEX, &deadline);
+    }
 
-    stack->hashData = oldHashData;
-    stack->hashStack = oldHashStack;
+    pthread_mutex_unlock(&_AUDIT_MUTEX);
 
-    return stackHash;
+    return NULL;
 }
 
-static ErrorCode _checkHash(Stack* stack)
+uint64_t _getTimeNs()
 {
-    MyAssertSoft(stack, ERROR_NULLPTR);
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
 
-    if (stack->hashData != _calculateDataHash(stack) || stack->hashStack != _calculateStackHash(stack))
-        return ERROR_BAD_HASH;
-    
-    return EVERYTHING_FINE;
+    return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
 }
-#endif
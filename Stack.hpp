@@ -6,14 +6,81 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "Utils.hpp"
+#include "StackTraits.hpp"
+#include "StackArena.hpp"
+#include "StackPages.hpp"
+#include "StackFile.hpp"
+#include "StackLog.hpp"
+#include "StackDump.hpp"
+#include "StackPoison.hpp"
+#include "StackStats.hpp"
+
+/** @enum StackProtection
+ * @brief Per-stack protection level, @see StackInit.
+ * 
+ * Only the protections enabled in Stack.settings are available,
+ * the rest are silently skipped.
+ * 
+ * @var STACK_PROTECTION_NONE - no checks at all, raw array speed.
+ * @var STACK_PROTECTION_CANARY - only canaries are checked.
+ * @var STACK_PROTECTION_HASH - canaries and stack hash are checked on every operation, the hash blocks
+ *                              of popped elements on every pop, the whole data hash only by @see CheckStackIntegrity.
+ * @var STACK_PROTECTION_PARANOID - full @see CheckStackIntegrity on every operation.
+ */
+enum StackProtection
+{
+    STACK_PROTECTION_NONE,
+    STACK_PROTECTION_CANARY,
+    STACK_PROTECTION_HASH,
+    STACK_PROTECTION_PARANOID,
+};
+
+/** @enum StackDumpFormat
+ * @brief How stacks are dumped to the log file, @see StackSetDumpFormat.
+ * 
+ * @var STACK_DUMP_TEXT - human-readable text, at most 4096 elements.
+ * @var STACK_DUMP_BINARY - one @see _StackDumpRecord with the whole buffer,
+ *                          StackDumpDecoder renders it as text. Stacks of
+ *                          non @see STACK_TRIVIAL types are still dumped as text.
+ */
+enum StackDumpFormat
+{
+    STACK_DUMP_TEXT,
+    STACK_DUMP_BINARY,
+};
+
+/**
+ * @brief Per-stack capacity policy, @see StackSetGrowthPolicy.
+ * 
+ * A full stack grows growFactor times. A stack with size <= capacity / shrinkDivisor
+ * shrinks growFactor times, so it is left half full rather than full and does not
+ * grow back on the next push. Capacity never shrinks below minCapacity.
+ * 
+ * @var StackGrowthPolicy::growFactor - at least 2.
+ * @var StackGrowthPolicy::shrinkDivisor - greater than growFactor.
+ * @var StackGrowthPolicy::minCapacity - at least 1.
+ * @var StackGrowthPolicy::noShrink - never shrink automatically, @see StackShrinkToFit still does.
+*/
+struct StackGrowthPolicy
+{
+    size_t growFactor;
+    size_t shrinkDivisor;
+    size_t minCapacity;
+    bool noShrink;
+};
 
 #include "Stack.settings"
 
 typedef size_t canary_t;
 
 /**
- * @brief Stack structure with hidden fields.
+ * @brief Stack of T with hidden fields, defined in StackImpl.hpp.
+ * 
+ * Elements are moved on push, pop and growth. Hash protection and poisoning
+ * are available for @see STACK_TRIVIAL types only, other types are at most
+ * @see STACK_PROTECTION_CANARY and must be default constructible.
 */
+template <typename T>
 struct Stack;
 
 /**
@@ -22,9 +89,10 @@ struct Stack;
  * @var StackResult::value - pointer to the stack.
  * @var StackResult::error - error message @see ErrorCode.
 */
+template <typename T>
 struct StackResult
 {
-    Stack* value;
+    Stack<T>* value;
     ErrorCode error;
 };
 
@@ -34,21 +102,67 @@ struct StackResult
  * @var StackElementResult::value - returned value.
  * @var StackElementResult::error - error message @see ErrorCode.
 */
+template <typename T>
 struct StackElementResult
 {
-    StackElement_t value;
+    T value;
+    ErrorCode error;
+};
+
+/**
+ * @brief Struct used for batch operations. On error value tells how many elements were processed.
+ * 
+ * @var StackCountResult::value - number of processed elements.
+ * @var StackCountResult::error - error message @see ErrorCode.
+*/
+struct StackCountResult
+{
+    size_t value;
     ErrorCode error;
 };
 
+/**
+ * @brief Called by the auditor when it finds a corrupted stack.
+ * 
+ * @param [in] stack - the corrupted stack.
+ * @param [in] error - what is wrong @see ErrorCode.
+ * @param [in] context - the context passed to @see StackAuditStart.
+*/
+typedef void (*StackAuditCallback)(void* stack, ErrorCode error, void* context);
+
 /**
  * @brief Initializes a stack.
  * 
- * @return Stack*.
+ * @param [in] type - element type.
+ * @param [in] protection - optional @see StackProtection, @see DEFAULT_PROTECTION if omitted.
+ * @param [in] arena - optional @see StackArena to allocate the stack from, the system allocator if omitted.
+ * 
+ * @return StackResult<type>.
 */
-#define StackInit()                                                                      \
+#define StackInit(type, ...)                                                             \
 ({                                                                                       \
     SourceCodePosition _owner = {__FILE__, __LINE__, __func__};                          \
-    _stackInit(&_owner);                                                                 \
+    _stackInit<type>(&_owner, ##__VA_ARGS__);                                            \
+})
+
+/**
+ * @brief Initializes a stack whose data lives between two PROT_NONE guard pages.
+ * 
+ * An overrun past the data buffer and its canaries faults at once and the stack is dumped
+ * to the log file before the process dies. Smaller overruns only hit the data canaries,
+ * which are checked as for any other stack.
+ * The buffer grows and shrinks with mremap, which moves pages instead of copying them.
+ * Capacity is rounded up to fill whole pages.
+ * 
+ * @param [in] type - element type.
+ * @param [in] protection - optional @see StackProtection, @see DEFAULT_PROTECTION if omitted.
+ * 
+ * @return StackResult<type>.
+*/
+#define StackInitGuarded(type, ...)                                                      \
+({                                                                                       \
+    SourceCodePosition _owner = {__FILE__, __LINE__, __func__};                          \
+    _stackInitGuarded<type>(&_owner, ##__VA_ARGS__);                                     \
 })
 
 /**
@@ -64,7 +178,12 @@ do
     }                                                                                    \
 } while (0);                        
 
-StackResult _stackInit(SourceCodePosition* owner);
+template <typename T>
+StackResult<T> _stackInit(SourceCodePosition* owner, StackProtection protection = DEFAULT_PROTECTION,
+                          StackArena* arena = NULL, bool guarded = false);
+
+template <typename T>
+StackResult<T> _stackInitGuarded(SourceCodePosition* owner, StackProtection protection = DEFAULT_PROTECTION);
 
 /**
  * @brief Destructor of a stack.
@@ -73,7 +192,8 @@ StackResult _stackInit(SourceCodePosition* owner);
  * 
  * @return @see @enum ErrorCode.
 */
-ErrorCode StackDestructor(Stack* stack);
+template <typename T>
+ErrorCode StackDestructor(Stack<T>* stack);
 
 /**
  * @brief Check the state of a stack.
@@ -82,27 +202,296 @@ ErrorCode StackDestructor(Stack* stack);
  * 
  * @return @see @enum ErrorCode.
 */
-ErrorCode CheckStackIntegrity(Stack* stack);
+template <typename T>
+ErrorCode CheckStackIntegrity(Stack<T>* stack);
+
+/**
+ * @brief Checks that every unused slot still holds the poison, which catches
+ * writes past the top of the stack without rehashing the data.
+ * 
+ * Also done by @see CheckStackIntegrity if POISON_PROTECTION is defined and
+ * the stack protection is not @see STACK_PROTECTION_NONE.
+ * Only if LAZY_POISON is defined (-DLAZY_POISON) the slots above the high-water mark
+ * are left unpoisoned when the buffer grows, and then they are not checked at all:
+ * a stray write there is caught neither here nor by the data hash.
+ * 
+ * @param [in] stack - the stack to check, T must be @see STACK_TRIVIAL.
+ * 
+ * @return @see @enum ErrorCode, ERROR_BAD_POISON if an unused slot was written.
+*/
+template <typename T>
+ErrorCode CheckStackPoison(Stack<T>* stack);
+
+/**
+ * @brief Sets how often Push and Pop verify the stack.
+ * 
+ * An operation verifies the stack if period operations passed or intervalNs nanoseconds
+ * passed since the last verification. If both are 0 the stack is verified only
+ * by @see StackCheckpoint. In any case it is verified at least every
+ * @see STACK_MAX_UNVERIFIED_OPS operations. @see STACK_PROTECTION_PARANOID stacks
+ * are verified on every operation. Operations that do not verify the stack still
+ * compare the stack hash in O(1) before signing the header again.
+ * 
+ * @param [in] stack - the stack.
+ * @param [in] period - verify every period-th operation, 1 to verify every operation.
+ * @param [in] intervalNs - verify if intervalNs nanoseconds passed.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+template <typename T>
+ErrorCode StackSetVerification(Stack<T>* stack, size_t period, uint64_t intervalNs);
+
+/**
+ * @brief Fully checks a stack and resets its unverified operations counter.
+ * 
+ * @param [in] stack - the stack to check.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+template <typename T>
+ErrorCode StackCheckpoint(Stack<T>* stack);
+
+/**
+ * @brief Sets the format of the following stack dumps, @see StackDumpFormat.
+ * 
+ * @param [in] format - the format.
+*/
+void StackSetDumpFormat(StackDumpFormat format);
+
+/**
+ * @brief Starts the background auditor thread.
+ * 
+ * Every periodNs nanoseconds it checks canaries and hashes of the registered stacks
+ * without stopping their owners. A check that overlapped a Push or Pop is discarded
+ * and retried on the next pass.
+ * 
+ * @param [in] periodNs - time between passes, @see DEFAULT_AUDIT_PERIOD_NS if 0.
+ * @param [in] callback - called on corruption, if NULL the stack is dumped to the log file.
+ * @param [in] context - passed to the callback.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+ErrorCode StackAuditStart(uint64_t periodNs, StackAuditCallback callback, void* context);
+
+/**
+ * @brief Stops the background auditor thread and waits for it.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+ErrorCode StackAuditStop();
+
+/**
+ * @brief Runs one audit pass over the registered stacks in the calling thread.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+ErrorCode StackAuditRun();
+
+/**
+ * @brief Registers a stack with the auditor.
+ * 
+ * The stack is switched to checkpoint-only verification @see StackSetVerification,
+ * so Push and Pop only bump its version and compare the stack hash.
+ * Must be called from the owner thread.
+ * 
+ * @param [in] stack - the stack to audit.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+template <typename T>
+ErrorCode StackAuditRegister(Stack<T>* stack);
+
+/**
+ * @brief Unregisters a stack from the auditor, @see StackDestructor does it automatically.
+ * 
+ * @param [in] stack - the stack.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+template <typename T>
+ErrorCode StackAuditUnregister(Stack<T>* stack);
+
+/**
+ * @brief Checks data hashes of blocks [firstBlock, firstBlock + numOfBlocks).
+ * 
+ * Data is hashed in blocks of @see STACK_HASH_BLOCK_SIZE elements, so a full
+ * check can be spread between several calls or threads.
+ * 
+ * @param [in] stack - the stack to check.
+ * @param [in] firstBlock - the first block to check.
+ * @param [in] numOfBlocks - how many blocks to check.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+template <typename T>
+ErrorCode CheckStackBlocks(Stack<T>* stack, size_t firstBlock, size_t numOfBlocks);
+
+/**
+ * @brief Returns the number of hash blocks of a stack.
+ * 
+ * @param [in] stack - the stack.
+ * 
+ * @return number of blocks, 0 if the stack is NULL.
+*/
+template <typename T>
+size_t StackBlocksCount(Stack<T>* stack);
+
+/**
+ * @brief Sets the capacity policy of a stack, @see DEFAULT_GROWTH_POLICY is used by default.
+ * 
+ * @param [in] stack - the stack.
+ * @param [in] policy - the new policy.
+ * 
+ * @return @see @enum ErrorCode, ERROR_BAD_VALUE if the policy is invalid.
+*/
+template <typename T>
+ErrorCode StackSetGrowthPolicy(Stack<T>* stack, StackGrowthPolicy policy);
+
+/**
+ * @brief Makes the stack hold at least capacity elements without reallocation.
+ * 
+ * The stack does not shrink below capacity until @see StackShrinkToFit.
+ * 
+ * @param [in] stack - the stack.
+ * @param [in] capacity - the capacity to reserve.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+template <typename T>
+ErrorCode StackReserve(Stack<T>* stack, size_t capacity);
+
+/**
+ * @brief Shrinks the capacity to the size, but not below the policy minCapacity, and drops the reservation.
+ * 
+ * @param [in] stack - the stack.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+template <typename T>
+ErrorCode StackShrinkToFit(Stack<T>* stack);
+
+/**
+ * @brief Returns how many times the stack changed its capacity.
+ * 
+ * @param [in] stack - the stack.
+ * 
+ * @return number of reallocations, 0 if the stack is NULL.
+*/
+template <typename T>
+size_t StackReallocationsCount(Stack<T>* stack);
+
+/**
+ * @brief Returns the operation counters of a stack, @see StackStats.
+ * 
+ * All zeros unless STACK_STATS is defined. Safe to call from any thread.
+ * 
+ * @param [in] stack - the stack.
+ * 
+ * @return the counters, zeros if the stack is NULL.
+*/
+template <typename T>
+StackStats StackGetStats(Stack<T>* stack);
+
+/**
+ * @brief Writes the elements to path in a binary format with block checksums.
+ * 
+ * The elements are written as they lie in memory, a block at a time, T must be @see STACK_TRIVIAL.
+ * The checksums use the current hash backend, which the file records. The file is written under
+ * a temporary name, synced and renamed over path, so a crash never leaves a half written file.
+ * 
+ * @param [in] stack - the stack.
+ * @param [in] path - the file, it is replaced.
+ * 
+ * @return @see @enum ErrorCode.
+*/
+template <typename T>
+ErrorCode StackSave(Stack<T>* stack, const char* path);
+
+/**
+ * @brief Pushes the elements saved by @see StackSave on top of the stack.
+ * 
+ * The file is mapped, its checksums are checked, then the elements are copied at once
+ * and only the hash blocks they land in are rehashed, every element once.
+ * 
+ * @param [in] stack - the stack.
+ * @param [in] path - the file.
+ * 
+ * @return @see @enum ErrorCode, ERROR_BAD_FILE if the file is not a saved stack of T
+ * or was checksummed with a hash backend this CPU lacks, ERROR_BAD_HASH if it is corrupted,
+ * then the stack is unchanged.
+*/
+template <typename T>
+ErrorCode StackLoad(Stack<T>* stack, const char* path);
 
-ErrorCode _stackDump(FILE* where, Stack* stack, SourceCodePosition* caller, ErrorCode error);
+template <typename T>
+ErrorCode _stackDump(FILE* where, Stack<T>* stack, SourceCodePosition* caller, ErrorCode error);
 
 /**
- * @brief Adds an element on top of stack.
+ * @brief Moves an element on top of stack.
  * 
  * @param [in] stack - the stack to add to.
  * @param [in] value - what to add.
  * 
  * @return error code.
 */
-ErrorCode Push(Stack* stack, StackElement_t value);
+template <typename T>
+ErrorCode Push(Stack<T>* stack, T value);
 
 /**
- * @brief Deletes and returns the top element of the stack.
+ * @brief Deletes the top element of the stack and moves it out.
+ * 
+ * The hash block holding the element is checked first, which costs @see STACK_HASH_BLOCK_SIZE
+ * slot hashes, so an element corrupted in memory gives ERROR_BAD_HASH and stays on the stack.
+ * The same goes for @see PopN, which checks every block it pops from once, but not for @see PeekN.
  * 
  * @param [in] stack - the stack to pop from.
  * 
  * @return Option containing value and error code.
 */
-StackElementResult Pop(Stack* stack);
+template <typename T>
+StackElementResult<T> Pop(Stack<T>* stack);
+
+/**
+ * @brief Adds count elements on top of stack, values[count - 1] becomes the top.
+ * 
+ * Grows the stack at most once and verifies it once per call. values may point at
+ * elements of the stack itself, but not at its unused slots.
+ * 
+ * @param [in] stack - the stack to add to.
+ * @param [in] values - what to add.
+ * @param [in] count - number of elements.
+ * 
+ * @return number of pushed elements and error code.
+*/
+template <typename T>
+StackCountResult PushN(Stack<T>* stack, const T* values, size_t count);
+
+/**
+ * @brief Deletes count top elements of the stack and moves them to values in stack order,
+ * so the old top ends up last. If the stack has fewer elements, pops all of them
+ * and returns @see ERROR_INDEX_OUT_OF_BOUNDS.
+ * 
+ * @param [in] stack - the stack to pop from.
+ * @param [out] values - where to copy the elements.
+ * @param [in] count - number of elements.
+ * 
+ * @return number of popped elements and error code.
+*/
+template <typename T>
+StackCountResult PopN(Stack<T>* stack, T* values, size_t count);
+
+/**
+ * @brief Copies count top elements of the stack to values like @see PopN without deleting them.
+ * 
+ * @param [in] stack - the stack to peek.
+ * @param [out] values - where to copy the elements.
+ * @param [in] count - number of elements.
+ * 
+ * @return number of copied elements and error code.
+*/
+template <typename T>
+StackCountResult PeekN(Stack<T>* stack, T* values, size_t count);
+
+#include "StackImpl.hpp"
 
 #endif
@@ -0,0 +1,350 @@
+#include <stdlib.h>
+#include <string.h>
+#include "StackArena.hpp"
+#include "Stack.hpp"
+#include "MinMax.hpp"
+
+/**
+ * @brief Memory the arena got from the system, freed in @see StackArenaDestroy.
+ *
+ * Small classes are carved from shared chunks, a block of a big class gets a chunk of its own.
+*/
+struct _ArenaChunk
+{
+    _ArenaChunk* next;
+    size_t size;
+};
+
+/**
+ * @brief Block bigger than the biggest class, returned to the system when freed.
+ *
+ * It comes from malloc, so that realloc can resize it in place. The header is placed
+ * offset bytes into the allocation, at the first cache line boundary, so the block is aligned like class blocks.
+*/
+struct _ArenaLargeBlock
+{
+    _ArenaLargeBlock* prev;
+    _ArenaLargeBlock* next;
+    size_t size;
+    size_t offset;
+};
+
+struct _ArenaFreeBlock
+{
+    _ArenaFreeBlock* next;
+};
+
+struct StackArena
+{
+    _ArenaFreeBlock* freeLists[STACK_ARENA_CLASSES];
+
+    _ArenaChunk* chunks;
+    char* chunkTop;
+    char* chunkEnd;
+
+    _ArenaLargeBlock* largeBlocks;
+};
+
+/**
+ * @brief Chunks are cache line aligned and headers are padded to a cache line, so class blocks are aligned too.
+*/
+static const size_t _ARENA_HEADER_SIZE = 64;
+
+/**
+ * @brief Room for the data canaries on top of every class.
+ *
+ * A data buffer of 2^k elements is _getRealDataSize bytes, a few more than a power of two,
+ * so without it every buffer of the growth sequence would take the next class and waste half of it.
+ * A cache line fits the canaries and the data offset of elements aligned up to 32 bytes.
+*/
+#ifdef CANARY_PROTECTION
+static const size_t _ARENA_CLASS_SLACK = 64;
+#else
+static const size_t _ARENA_CLASS_SLACK = 0;
+#endif
+
+static size_t _getClassSize(size_t sizeClass);
+
+static size_t _getSizeClass(size_t size);
+
+static void* _allocClassBlock(StackArena* arena, size_t sizeClass);
+
+static void* _allocChunk(StackArena* arena, size_t size);
+
+static void* _allocLargeBlock(StackArena* arena, size_t size);
+
+static void* _reallocLargeBlock(StackArena* arena, void* block, size_t newSize);
+
+static void _freeLargeBlock(StackArena* arena, void* block);
+
+static size_t _getLargeBlockOffset(const void* allocation);
+
+static void _linkLargeBlock(StackArena* arena, _ArenaLargeBlock* largeBlock);
+
+StackArenaResult StackArenaCreate()
+{
+    StackArena* arena = (StackArena*)calloc(1, sizeof(StackArena));
+
+    if (!arena)
+        return {NULL, ERROR_NO_MEMORY};
+
+    return {arena, EVERYTHING_FINE};
+}
+
+ErrorCode StackArenaDestroy(StackArena* arena)
+{
+    MyAssertSoft(arena, ERROR_NULLPTR);
+
+    _ArenaChunk* chunk = arena->chunks;
+
+    while (chunk)
+    {
+        _ArenaChunk* next = chunk->next;
+
+        #ifdef STACK_STATS
+        _statsDetachRange((char*)chunk + _ARENA_HEADER_SIZE, (char*)chunk + _ARENA_HEADER_SIZE + chunk->size);
+        #endif
+
+        free(chunk);
+        chunk = next;
+    }
+
+    _ArenaLargeBlock* largeBlock = arena->largeBlocks;
+
+    while (largeBlock)
+    {
+        _ArenaLargeBlock* next = largeBlock->next;
+
+        #ifdef STACK_STATS
+        _statsDetachRange((char*)largeBlock + _ARENA_HEADER_SIZE, (char*)largeBlock + _ARENA_HEADER_SIZE + largeBlock->size);
+        #endif
+
+        free((char*)largeBlock - largeBlock->offset);
+        largeBlock = next;
+    }
+
+    free(arena);
+
+    return EVERYTHING_FINE;
+}
+
+void* _arenaAlloc(StackArena* arena, size_t size)
+{
+    if (!arena)
+        return NULL;
+
+    size_t sizeClass = _getSizeClass(size);
+
+    if (sizeClass == STACK_ARENA_CLASSES)
+        return _allocLargeBlock(arena, size);
+
+    _ArenaFreeBlock* block = arena->freeLists[sizeClass];
+
+    if (block)
+    {
+        arena->freeLists[sizeClass] = block->next;
+        return block;
+    }
+
+    return _allocClassBlock(arena, sizeClass);
+}
+
+void _arenaFree(StackArena* arena, void* block, size_t size)
+{
+    if (!arena || !block)
+        return;
+
+    size_t sizeClass = _getSizeClass(size);
+
+    if (sizeClass == STACK_ARENA_CLASSES)
+    {
+        _freeLargeBlock(arena, block);
+        return;
+    }
+
+    _ArenaFreeBlock* freeBlock = (_ArenaFreeBlock*)block;
+
+    freeBlock->next = arena->freeLists[sizeClass];
+    arena->freeLists[sizeClass] = freeBlock;
+}
+
+void* _arenaRealloc(StackArena* arena, void* block, size_t oldSize, size_t newSize)
+{
+    if (!arena)
+        return NULL;
+
+    if (!block)
+        return _arenaAlloc(arena, newSize);
+
+    size_t oldClass = _getSizeClass(oldSize);
+    size_t newClass = _getSizeClass(newSize);
+
+    if (oldClass == STACK_ARENA_CLASSES && newClass == STACK_ARENA_CLASSES)
+        return _reallocLargeBlock(arena, block, newSize);
+
+    if (oldClass == newClass)
+        return block;
+
+    void* newBlock = _arenaAlloc(arena, newSize);
+
+    if (!newBlock)
+        return NULL;
+
+    memcpy(newBlock, block, min(oldSize, newSize));
+
+    _arenaFree(arena, block, oldSize);
+
+    return newBlock;
+}
+
+static size_t _getClassSize(size_t sizeClass)
+{
+    size_t classSize = STACK_ARENA_MIN_BLOCK;
+
+    for (size_t i = 0; i < sizeClass; i++)
+        classSize *= STACK_GROW_FACTOR;
+
+    return classSize + _ARENA_CLASS_SLACK;
+}
+
+/**
+ * @brief Smallest class that fits size bytes, STACK_ARENA_CLASSES if none does.
+*/
+static size_t _getSizeClass(size_t size)
+{
+    size_t classSize = STACK_ARENA_MIN_BLOCK;
+
+    for (size_t sizeClass = 0; sizeClass < STACK_ARENA_CLASSES; sizeClass++)
+    {
+        if (size <= classSize + _ARENA_CLASS_SLACK)
+            return sizeClass;
+
+        classSize *= STACK_GROW_FACTOR;
+    }
+
+    return STACK_ARENA_CLASSES;
+}
+
+static void* _allocClassBlock(StackArena* arena, size_t sizeClass)
+{
+    size_t classSize = _getClassSize(sizeClass);
+
+    if (classSize > STACK_ARENA_CHUNK_SIZE / 4)
+        return _allocChunk(arena, classSize);
+
+    if ((size_t)(arena->chunkEnd - arena->chunkTop) < classSize)
+    {
+        char* chunkData = (char*)_allocChunk(arena, STACK_ARENA_CHUNK_SIZE);
+
+        if (!chunkData)
+            return NULL;
+
+        arena->chunkTop = chunkData;
+        arena->chunkEnd = chunkData + STACK_ARENA_CHUNK_SIZE;
+    }
+
+    void* block = arena->chunkTop;
+    arena->chunkTop += classSize;
+
+    return block;
+}
+
+static void* _allocChunk(StackArena* arena, size_t size)
+{
+    _ArenaChunk* chunk = (_ArenaChunk*)aligned_alloc(_ARENA_HEADER_SIZE, _ARENA_HEADER_SIZE + size);
+
+    if (!chunk)
+        return NULL;
+
+    chunk->size = size;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    return (char*)chunk + _ARENA_HEADER_SIZE;
+}
+
+static void* _allocLargeBlock(StackArena* arena, size_t size)
+{
+    // Room for the header and for aligning it
+    char* allocation = (char*)malloc(2 * _ARENA_HEADER_SIZE + size);
+
+    if (!allocation)
+        return NULL;
+
+    size_t offset = _getLargeBlockOffset(allocation);
+    _ArenaLargeBlock* largeBlock = (_ArenaLargeBlock*)(allocation + offset);
+
+    largeBlock->prev = NULL;
+    largeBlock->next = arena->largeBlocks;
+    largeBlock->size = size;
+    largeBlock->offset = offset;
+
+    _linkLargeBlock(arena, largeBlock);
+
+    return (char*)largeBlock + _ARENA_HEADER_SIZE;
+}
+
+/**
+ * @brief Resizes a large block with realloc, the header and the data are moved only if realloc changed their alignment.
+*/
+static void* _reallocLargeBlock(StackArena* arena, void* block, size_t newSize)
+{
+    _ArenaLargeBlock* largeBlock = (_ArenaLargeBlock*)((char*)block - _ARENA_HEADER_SIZE);
+
+    size_t oldSize   = largeBlock->size;
+    size_t oldOffset = largeBlock->offset;
+
+    char* allocation = (char*)realloc((char*)largeBlock - oldOffset, 2 * _ARENA_HEADER_SIZE + newSize);
+
+    if (!allocation)
+        return NULL;
+
+    size_t newOffset = _getLargeBlockOffset(allocation);
+
+    if (newOffset != oldOffset)
+        memmove(allocation + newOffset, allocation + oldOffset, _ARENA_HEADER_SIZE + min(oldSize, newSize));
+
+    largeBlock = (_ArenaLargeBlock*)(allocation + newOffset);
+
+    largeBlock->size = newSize;
+    largeBlock->offset = newOffset;
+
+    // The neighbours still point to the old header
+    _linkLargeBlock(arena, largeBlock);
+
+    return (char*)largeBlock + _ARENA_HEADER_SIZE;
+}
+
+static void _freeLargeBlock(StackArena* arena, void* block)
+{
+    _ArenaLargeBlock* largeBlock = (_ArenaLargeBlock*)((char*)block - _ARENA_HEADER_SIZE);
+
+    if (largeBlock->prev)
+        largeBlock->prev->next = largeBlock->next;
+    else
+        arena->largeBlocks = largeBlock->next;
+
+    if (largeBlock->next)
+        largeBlock->next->prev = largeBlock->prev;
+
+    free((char*)largeBlock - largeBlock->offset);
+}
+
+static size_t _getLargeBlockOffset(const void* allocation)
+{
+    return (_ARENA_HEADER_SIZE - (uintptr_t)allocation % _ARENA_HEADER_SIZE) % _ARENA_HEADER_SIZE;
+}
+
+/**
+ * @brief Points the neighbours of a large block, or the list head, at its header.
+*/
+static void _linkLargeBlock(StackArena* arena, _ArenaLargeBlock* largeBlock)
+{
+    if (largeBlock->prev)
+        largeBlock->prev->next = largeBlock;
+    else
+        arena->largeBlocks = largeBlock;
+
+    if (largeBlock->next)
+        largeBlock->next->prev = largeBlock;
+}
@@ -0,0 +1,70 @@
+//! @file
+
+#ifndef STACK_ARENA_HPP
+#define STACK_ARENA_HPP
+
+#include <stddef.h>
+#include "Utils.hpp"
+
+/**
+ * @brief Pool of memory for stacks that avoids the system allocator.
+ *
+ * Blocks come in size classes STACK_ARENA_MIN_BLOCK * STACK_GROW_FACTOR ** k plus
+ * room for the data canaries, the same geometric sequence stacks grow by, so a growing
+ * or shrinking stack moves between neighbouring classes and fills them. Freed blocks are kept in per class
+ * free lists and reused, the memory goes back to the system only in
+ * @see StackArenaDestroy.
+ *
+ * An arena is not thread safe, all its stacks must be used by one thread at a time.
+*/
+struct StackArena;
+
+/**
+ * @brief Struct that @see StackArenaCreate returns. If error is not 0, then value = NULL.
+ *
+ * @var StackArenaResult::value - pointer to the arena.
+ * @var StackArenaResult::error - error message @see ErrorCode.
+*/
+struct StackArenaResult
+{
+    StackArena* value;
+    ErrorCode error;
+};
+
+/**
+ * @brief Creates an empty arena, pass it to @see StackInit to allocate stacks from it.
+ *
+ * @return @see StackArenaResult.
+*/
+StackArenaResult StackArenaCreate();
+
+/**
+ * @brief Frees the arena with all stacks allocated from it at once.
+ *
+ * The stacks must not be used afterwards and must not be registered with the auditor.
+ * With STACK_STATS their counters go to the global ones as if they were destroyed.
+ *
+ * @param [in] arena - the arena.
+ *
+ * @return @see ErrorCode.
+*/
+ErrorCode StackArenaDestroy(StackArena* arena);
+
+/**
+ * @brief Allocates size bytes from the arena.
+*/
+void* _arenaAlloc(StackArena* arena, size_t size);
+
+/**
+ * @brief Returns a block of size bytes to the arena.
+*/
+void _arenaFree(StackArena* arena, void* block, size_t size);
+
+/**
+ * @brief Resizes a block like realloc, a block that stays in its size class is not moved.
+ *
+ * Blocks bigger than every class are resized by realloc, which can grow them in place.
+*/
+void* _arenaRealloc(StackArena* arena, void* block, size_t oldSize, size_t newSize);
+
+#endif
@@ -0,0 +1,81 @@
+//! @file
+
+#ifndef STACK_DUMP_HPP
+#define STACK_DUMP_HPP
+
+#include <stdint.h>
+
+/**
+ * @brief Bytes D0 "STKDMP" and the format version, not valid text, so a record is found in a text log.
+*/
+static const uint64_t STACK_DUMP_MAGIC = 0x02504D444B5453D0;
+
+/** @enum _StackDumpFlags
+ * @brief Which parts of @see _StackDumpRecord are filled.
+ */
+enum _StackDumpFlags
+{
+    _STACK_DUMP_HASH     = 1 << 0,
+    _STACK_DUMP_CANARY   = 1 << 1,
+    _STACK_DUMP_GUARDED  = 1 << 2,
+    _STACK_DUMP_NOSHRINK = 1 << 3,
+};
+
+/**
+ * @brief Binary stack dump, written to the log file as is and rendered by StackDumpDecoder.
+ *
+ * The record is followed by the origin file and function, the caller file and function,
+ * the element specifier (no terminating zeros), blocksCount pairs of stored and expected
+ * hash block values, the poison element and highWaterMark elements of raw data,
+ * the slots above them up to capacity are poison.
+ * Values with a stored and an expected version are invalid when the two differ.
+*/
+struct _StackDumpRecord
+{
+    uint64_t magic;
+    uint64_t recordSize;
+
+    uint64_t stack;
+    uint32_t error;
+    uint32_t protection;
+    uint32_t flags;
+    uint32_t elementSize;
+
+    uint64_t opsSinceVerified;
+
+    uint32_t hashData;
+    uint32_t expectedHashData;
+    uint32_t hashStack;
+    uint32_t expectedHashStack;
+    uint64_t blocksCount;
+    uint64_t blockSize;
+
+    uint64_t leftCanary;
+    uint64_t rightCanary;
+    uint64_t leftDataCanary;
+    uint64_t rightDataCanary;
+    uint64_t expectedCanary;
+
+    uint64_t size;
+    uint64_t capacity;
+    uint64_t highWaterMark;
+    uint64_t reservedCapacity;
+    uint64_t reallocations;
+    uint64_t growFactor;
+    uint64_t shrinkDivisor;
+    uint64_t minCapacity;
+
+    uint64_t data;
+    uint64_t mappedSize;
+
+    uint64_t originLine;
+    uint64_t callerLine;
+    uint32_t originFileLength;
+    uint32_t originNameLength;
+    uint32_t callerFileLength;
+    uint32_t callerNameLength;
+    uint32_t specifierLength;
+    uint32_t reserved;
+};
+
+#endif
@@ -0,0 +1,262 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Stack.hpp"
+#include "StackFile.hpp"
+
+/**
+ * @brief "STACKBIN", xored with @see _STACK_FILE_FORMAT_VERSION.
+*/
+static const uint64_t _STACK_FILE_MAGIC = 0x4E49424B43415453;
+
+static const uint64_t _STACK_FILE_FORMAT_VERSION = 2;
+
+/**
+ * @brief Elements start on a cache line, so the mapped array is aligned for any element type.
+*/
+static const size_t _STACK_FILE_DATA_ALIGNMENT = 64;
+
+static uint64_t _calculateHeaderHash(const _StackFileHeader* header);
+
+static bool _syncParentDirectory(const char* path);
+
+/**
+ * @brief Makes temporary file names of concurrent saves in one process differ.
+*/
+static unsigned int _TEMP_FILE_COUNTER = 0;
+
+static inline size_t _getFileBlocksCount(size_t dataSize, size_t blockSize)
+{
+    return (dataSize + blockSize - 1) / blockSize;
+}
+
+ErrorCode _stackFileWrite(const char* path, const void* data, size_t elementSize, size_t size)
+{
+    MyAssertSoft(path, ERROR_NULLPTR);
+    MyAssertSoft(data || size == 0, ERROR_NULLPTR);
+
+    const char* bytes = (const char*)data;
+    HashBackend backend = GetHashBackend();
+    size_t dataSize = size * elementSize;
+    size_t blocksCount = _getFileBlocksCount(dataSize, STACK_FILE_BLOCK_SIZE);
+
+    unsigned int* checksums = (unsigned int*)calloc(blocksCount + 1, sizeof(unsigned int));
+
+    if (!checksums)
+        return ERROR_NO_MEMORY;
+
+    _StackFileHeader header =
+    {
+        .magic = _STACK_FILE_MAGIC ^ _STACK_FILE_FORMAT_VERSION,
+        .elementSize = elementSize,
+        .size = size,
+        .blockSize = STACK_FILE_BLOCK_SIZE,
+        .dataOffset = _STACK_FILE_DATA_ALIGNMENT,
+        .hashBackend = backend,
+        .headerHash = 0,
+    };
+
+    header.headerHash = _calculateHeaderHash(&header);
+
+    char headerBlock[_STACK_FILE_DATA_ALIGNMENT] = {};
+    memcpy(headerBlock, &header, sizeof(header));
+
+    size_t tempPathSize = strlen(path) + 32;
+    char* tempPath = (char*)calloc(tempPathSize, sizeof(char));
+
+    if (!tempPath)
+    {
+        free(checksums);
+        return ERROR_NO_MEMORY;
+    }
+
+    snprintf(tempPath, tempPathSize, "%s.%d.%u.tmp", path, (int)getpid(),
+             __atomic_fetch_add(&_TEMP_FILE_COUNTER, 1, __ATOMIC_RELAXED));
+
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    FILE* file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+
+    if (!file)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(tempPath);
+        }
+
+        free(tempPath);
+        free(checksums);
+        return ERROR_BAD_FILE;
+    }
+
+    // Blocks are big enough to go straight to the file, the buffer would only add a copy
+    setvbuf(file, NULL, _IONBF, 0);
+
+    bool written = fwrite(headerBlock, sizeof(headerBlock), 1, file) == 1;
+
+    for (size_t block = 0; written && block < blocksCount; block++)
+    {
+        size_t offset = block * STACK_FILE_BLOCK_SIZE;
+        size_t blockSize = min(STACK_FILE_BLOCK_SIZE, dataSize - offset);
+
+        checksums[block] = CalculateBackendHash(backend, bytes + offset, blockSize, HASH_SEED ^ (hash_t)block);
+
+        written = fwrite(bytes + offset, 1, blockSize, file) == blockSize;
+    }
+
+    if (written && blocksCount)
+        written = fwrite(checksums, sizeof(unsigned int), blocksCount, file) == blocksCount;
+
+    free(checksums);
+
+    // The data must be on the disk before the rename makes it the file at path
+    written = written && fflush(file) == 0 && fsync(fd) == 0;
+
+    if (fclose(file) != 0 || !written || rename(tempPath, path) != 0)
+    {
+        unlink(tempPath);
+        free(tempPath);
+        return ERROR_BAD_FILE;
+    }
+
+    free(tempPath);
+
+    if (!_syncParentDirectory(path))
+        return ERROR_BAD_FILE;
+
+    return EVERYTHING_FINE;
+}
+
+ErrorCode _stackFileMap(const char* path, size_t elementSize, _StackFileMapping* file)
+{
+    MyAssertSoft(path, ERROR_NULLPTR);
+    MyAssertSoft(file, ERROR_NULLPTR);
+
+    *file = {};
+
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return ERROR_BAD_FILE;
+
+    struct stat fileStat = {};
+
+    if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(_StackFileHeader))
+    {
+        close(fd);
+        return ERROR_BAD_FILE;
+    }
+
+    size_t fileSize = (size_t)fileStat.st_size;
+
+    char* mapping = (char*)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+        return ERROR_NO_MEMORY;
+
+    madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+    const _StackFileHeader* header = (const _StackFileHeader*)mapping;
+
+    ErrorCode error = EVERYTHING_FINE;
+
+    if (header->magic != (_STACK_FILE_MAGIC ^ _STACK_FILE_FORMAT_VERSION) ||
+        header->headerHash != _calculateHeaderHash(header) ||
+        !IsHashBackendSupported((HashBackend)header->hashBackend))
+        error = ERROR_BAD_FILE;
+
+    else if (header->elementSize != elementSize || header->blockSize == 0 ||
+             header->dataOffset % _STACK_FILE_DATA_ALIGNMENT != 0 || header->dataOffset > fileSize ||
+             header->size > (fileSize - header->dataOffset) / elementSize)
+        error = ERROR_BAD_FILE;
+
+    size_t dataSize = 0, blocksCount = 0;
+
+    if (!error)
+    {
+        dataSize = header->size * elementSize;
+        blocksCount = _getFileBlocksCount(dataSize, header->blockSize);
+
+        if (fileSize != header->dataOffset + dataSize + blocksCount * sizeof(unsigned int))
+            error = ERROR_BAD_FILE;
+    }
+
+    const char* data = mapping + header->dataOffset;
+    const unsigned int* checksums = (const unsigned int*)(data + dataSize);
+
+    for (size_t block = 0; !error && block < blocksCount; block++)
+    {
+        size_t offset = block * header->blockSize;
+        size_t blockSize = min((size_t)header->blockSize, dataSize - offset);
+
+        unsigned int checksum = 0;
+        memcpy(&checksum, checksums + block, sizeof(checksum));
+
+        if (checksum != CalculateBackendHash((HashBackend)header->hashBackend, data + offset, blockSize,
+                                             HASH_SEED ^ (hash_t)block))
+            error = ERROR_BAD_HASH;
+    }
+
+    if (error)
+    {
+        munmap(mapping, fileSize);
+        return error;
+    }
+
+    *file =
+    {
+        .mapping = mapping,
+        .mappingSize = fileSize,
+        .data = data,
+        .size = header->size,
+    };
+
+    return EVERYTHING_FINE;
+}
+
+void _stackFileUnmap(_StackFileMapping* file)
+{
+    if (!file || !file->mapping)
+        return;
+
+    munmap(file->mapping, file->mappingSize);
+
+    *file = {};
+}
+
+static uint64_t _calculateHeaderHash(const _StackFileHeader* header)
+{
+    _StackFileHeader headerCopy = *header;
+    headerCopy.headerHash = 0;
+
+    return CalculatePortableHash(&headerCopy, sizeof(headerCopy), HASH_SEED);
+}
+
+/**
+ * @brief Syncs the directory of path, so a rename into it survives a crash.
+*/
+static bool _syncParentDirectory(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+
+    char* directory = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+
+    if (!directory)
+        return false;
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+
+    free(directory);
+
+    if (fd < 0)
+        return false;
+
+    bool synced = fsync(fd) == 0;
+
+    close(fd);
+
+    return synced;
+}
@@ -0,0 +1,71 @@
+//! @file
+
+#ifndef STACK_FILE_HPP
+#define STACK_FILE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Utils.hpp"
+
+/**
+ * @brief Header of a file written by @see StackSave.
+ *
+ * The elements follow at dataOffset as one contiguous array, then come the
+ * checksums of every blockSize bytes of it, so a mapped file is used in place.
+ * The checksums use the hash backend of the writer, the header hash is portable.
+ *
+ * @var _StackFileHeader::magic - "STACKBIN" xor the format version.
+ * @var _StackFileHeader::elementSize - sizeof the element type.
+ * @var _StackFileHeader::size - number of elements, the bottom one first.
+ * @var _StackFileHeader::blockSize - bytes covered by each checksum.
+ * @var _StackFileHeader::dataOffset - where the elements start.
+ * @var _StackFileHeader::hashBackend - @see HashBackend of the block checksums.
+ * @var _StackFileHeader::headerHash - hash of the header with headerHash = 0.
+*/
+struct _StackFileHeader
+{
+    uint64_t magic;
+    uint64_t elementSize;
+    uint64_t size;
+    uint64_t blockSize;
+    uint64_t dataOffset;
+    uint64_t hashBackend;
+    uint64_t headerHash;
+};
+
+/**
+ * @brief Verified file contents mapped by @see _stackFileMap.
+*/
+struct _StackFileMapping
+{
+    void* mapping;
+    size_t mappingSize;
+
+    const void* data;
+    size_t size;
+};
+
+/**
+ * @brief Writes size elements of elementSize bytes to path in the @see _StackFileHeader format.
+ *
+ * The file is written and synced under a temporary name next to path, then renamed over it,
+ * so path holds either the old contents or the whole new file.
+ *
+ * @return @see ErrorCode, ERROR_BAD_FILE if the file can't be written.
+*/
+ErrorCode _stackFileWrite(const char* path, const void* data, size_t elementSize, size_t size);
+
+/**
+ * @brief Maps the file at path read-only and checks its header and every block checksum.
+ *
+ * @return @see ErrorCode, ERROR_BAD_FILE if the file can't be read, holds other elements
+ * or its checksums use a hash backend the CPU does not support, ERROR_BAD_HASH if a checksum does not match.
+*/
+ErrorCode _stackFileMap(const char* path, size_t elementSize, _StackFileMapping* file);
+
+/**
+ * @brief Unmaps a file from @see _stackFileMap.
+*/
+void _stackFileUnmap(_StackFileMapping* file);
+
+#endif
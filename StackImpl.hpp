@@ -0,0 +1,2564 @@
+//! @file
+
+#ifndef STACK_IMPL_HPP
+#define STACK_IMPL_HPP
+
+#include <time.h>
+#include <string.h>
+#include <pthread.h>
+#include <new>
+#include <utility>
+#include <x86intrin.h>
+#include "Stack.hpp"
+#include "MinMax.hpp"
+
+typedef unsigned int hash_t;
+
+static const hash_t HASH_SEED = 0xBEBDA;
+
+extern FILE* LOG_FILE;
+
+extern StackDumpFormat _DUMP_FORMAT;
+
+#ifdef CANARY_PROTECTION
+extern const canary_t _CANARY;
+#endif
+
+/**
+ * @brief Guards the auditor state and reallocation of audited stacks.
+*/
+extern pthread_mutex_t _AUDIT_MUTEX;
+
+typedef ErrorCode (*_AuditFunction)(void* stack);
+
+typedef ErrorCode (*_DumpFunction)(FILE* where, void* stack, SourceCodePosition* caller, ErrorCode error);
+
+/**
+ * @brief Adds a stack to the auditor, must be called under @see _AUDIT_MUTEX.
+*/
+ErrorCode _auditAdd(void* stack, _AuditFunction audit, _DumpFunction dump);
+
+/**
+ * @brief Removes a stack from the auditor, must be called under @see _AUDIT_MUTEX.
+*/
+ErrorCode _auditRemove(void* stack);
+
+uint64_t _getTimeNs();
+
+/**
+ * @brief Dumps the stack to the log file on error, only if DEBUG is defined.
+*/
+#ifdef DEBUG
+#define _STACK_DUMP_ERROR_DEBUG(stack, error)                                            \
+do                                                                                       \
+{                                                                                        \
+    if (error && stack && LOG_FILE)                                                      \
+    {                                                                                    \
+        SourceCodePosition _caller = {__FILE__, __LINE__, __func__};                     \
+        _stackDump(LOG_FILE, stack, &_caller, error);                                    \
+        fflush(LOG_FILE);                                                                \
+    }                                                                                    \
+} while (0);
+#else
+#define _STACK_DUMP_ERROR_DEBUG(stack, error) do {} while (0);
+#endif
+
+/**
+ * @brief Update the @see StackStats of a stack, only if STACK_STATS is defined.
+ *
+ * Only the owner thread writes the counters, so no atomic read-modify-write is needed.
+ * _STACK_STATS_TIMED evaluates to the checked expression. One in STACK_STATS_TIME_SAMPLE
+ * checks of a stack is timed with rdtsc and counted STACK_STATS_TIME_SAMPLE times,
+ * as rdtsc costs more than a canary check.
+*/
+#ifdef STACK_STATS
+#define _STACK_STATS_ADD(stack, counter, value)                                          \
+    __atomic_store_n(&(stack)->stats.counters.counter,                                   \
+                     (stack)->stats.counters.counter + (value), __ATOMIC_RELAXED)
+
+#define _STACK_STATS_MAX(stack, counter, value)                                          \
+do                                                                                       \
+{                                                                                        \
+    if ((stack)->stats.counters.counter < (value))                                       \
+        __atomic_store_n(&(stack)->stats.counters.counter, (value), __ATOMIC_RELAXED);   \
+} while (0)
+
+#define _STACK_STATS_TIMED(stack, counter, ...)                                          \
+({                                                                                       \
+    bool _sampled = (stack)->stats.timedChecks++ % STACK_STATS_TIME_SAMPLE == 0;         \
+    uint64_t _begin = _sampled ? __rdtsc() : 0;                                          \
+    __typeof__(__VA_ARGS__) _result = __VA_ARGS__;                                       \
+    if (_sampled)                                                                        \
+        _STACK_STATS_ADD(stack, counter, (__rdtsc() - _begin) * STACK_STATS_TIME_SAMPLE); \
+    _result;                                                                             \
+})
+#else
+#define _STACK_STATS_ADD(stack, counter, value) do {} while (0)
+#define _STACK_STATS_MAX(stack, counter, value) do {} while (0)
+#define _STACK_STATS_TIMED(stack, counter, ...) (__VA_ARGS__)
+#endif
+
+/**
+ * @brief Offset of the data from the beginning of its buffer, keeps data aligned after the left canary.
+*/
+template <typename T>
+static constexpr size_t _getDataOffset()
+{
+    #ifdef CANARY_PROTECTION
+    return alignof(T) > sizeof(canary_t) ? alignof(T) : sizeof(canary_t);
+    #else
+    return 0;
+    #endif
+}
+
+/**
+ * @brief Size of the data buffer with canaries for capacity elements.
+*/
+template <typename T>
+static constexpr size_t _getRealDataSize(size_t capacity)
+{
+    #ifdef CANARY_PROTECTION
+    size_t dataSize = (capacity * sizeof(T) + sizeof(canary_t) - 1) / sizeof(canary_t) * sizeof(canary_t);
+
+    return _getDataOffset<T>() + dataSize + sizeof(canary_t);
+    #else
+    return capacity * sizeof(T);
+    #endif
+}
+
+/**
+ * @brief Stack header with the first STACK_INLINE_CAPACITY elements.
+ *
+ * A small stack is a single cache line aligned allocation: data points into
+ * inlineData, which has the same canary, data, canary layout as a heap buffer.
+ * The heap buffer is allocated only once the stack grows past STACK_INLINE_CAPACITY,
+ * and the stack moves back inline when it shrinks. The same goes for the first hash block.
+ *
+ * inlineData is not covered by the stack hash, it is part of the data.
+ *
+ * Slots [size, highWaterMark) hold poison. Without LAZY_POISON the mark stays at capacity,
+ * with it slots [highWaterMark, capacity) have never been written since the buffer grew,
+ * are poisoned only logically and are not checked, @see _poisonNewSlots.
+ *
+ * stats is not covered by the stack hash and canaries either, it is written on every
+ * operation and its links change when other stacks come and go, @see StackStats.
+*/
+template <typename T>
+struct alignas(64) Stack
+{
+    #ifdef CANARY_PROTECTION
+    canary_t leftCanary;
+    #endif
+
+    size_t realDataSize;
+    T* data;
+
+    SourceCodePosition origin;
+    size_t size;
+    size_t capacity;
+    size_t highWaterMark;
+
+    StackGrowthPolicy growthPolicy;
+    size_t reservedCapacity;
+    size_t reallocations;
+
+    StackProtection protection;
+
+    size_t verifyPeriod;
+    uint64_t verifyIntervalNs;
+    uint64_t lastVerifiedNs;
+    size_t opsSinceVerified;
+
+    bool audited;
+    uint64_t version;
+
+    StackArena* arena;
+    bool guarded;
+    size_t mappedSize;
+
+    #ifdef HASH_PROTECTION
+    hash_t* hashBlocks;
+    size_t hashBlocksAllocated;
+    hash_t inlineHashBlock;
+    hash_t hashData;
+    hash_t hashStack;
+    #endif
+
+    #ifdef CANARY_PROTECTION
+    canary_t rightCanary;
+    #endif
+
+    alignas(T) alignas(canary_t) char inlineData[_getRealDataSize<T>(STACK_INLINE_CAPACITY)];
+
+    #ifdef STACK_STATS
+    _StackStatsNode stats;
+    #endif
+};
+
+static const char* STACK_PROTECTION_NAMES[] =
+{
+    "STACK_PROTECTION_NONE", "STACK_PROTECTION_CANARY", "STACK_PROTECTION_HASH", "STACK_PROTECTION_PARANOID",
+};
+
+template <typename T>
+static inline bool _isCanaryOn(const Stack<T>* stack)
+{
+    #ifdef CANARY_PROTECTION
+    return stack->protection >= STACK_PROTECTION_CANARY;
+    #else
+    return false;
+    #endif
+}
+
+template <typename T>
+static inline bool _isPoisonOn(const Stack<T>* stack)
+{
+    #ifdef POISON_PROTECTION
+    return STACK_TRIVIAL<T> && stack->protection >= STACK_PROTECTION_CANARY;
+    #else
+    return false;
+    #endif
+}
+
+template <typename T>
+static inline bool _isHashOn(const Stack<T>* stack)
+{
+    #ifdef HASH_PROTECTION
+    return STACK_TRIVIAL<T> && stack->protection >= STACK_PROTECTION_HASH;
+    #else
+    return false;
+    #endif
+}
+
+/**
+ * @brief Poison for trivial types, default value for the rest.
+*/
+template <typename T>
+static inline T _getPoison()
+{
+    if constexpr (STACK_TRIVIAL<T>)
+        return StackTraits<T>::Poison();
+    else
+        return T();
+}
+
+template <typename T>
+static inline bool _isPoison(const T* slot)
+{
+    T poison = _getPoison<T>();
+
+    return memcmp((const void*)slot, (const void*)&poison, sizeof(T)) == 0;
+}
+
+/**
+ * @brief Poisons unused slots [from, to), does nothing for non-trivial types.
+*/
+template <typename T>
+static inline void _poisonSlots(T* data, size_t from, size_t to)
+{
+    if constexpr (STACK_TRIVIAL<T>)
+    {
+        T poison = _getPoison<T>();
+
+        if ((to - from) * sizeof(T) >= STACK_POISON_SIMD_MIN_SIZE)
+        {
+            _fillPattern((void*)(data + from), (const void*)&poison, sizeof(T), to - from);
+            return;
+        }
+
+        for (size_t i = from; i < to; i++)
+            memcpy((void*)&data[i], (const void*)&poison, sizeof(T));
+    }
+}
+
+/**
+ * @brief Poisons the new slots [from, to) of a grown buffer.
+ *
+ * Only if LAZY_POISON is defined (-DLAZY_POISON) they are left untouched above
+ * the high-water mark, so their pages are not committed until the stack reaches them.
+ * Such slots are not checked at all: a stray write above the mark is caught
+ * neither by the poison check nor by the data hash.
+*/
+template <typename T>
+static inline void _poisonNewSlots(Stack<T>* stack, size_t from, size_t to)
+{
+    #ifndef LAZY_POISON
+    _poisonSlots(stack->data, from, to);
+    stack->highWaterMark = to;
+    #endif
+}
+
+/**
+ * @brief Tells if a slot is poisoned, slots above the high-water mark are not read.
+*/
+template <typename T>
+static inline bool _isSlotPoisoned(const Stack<T>* stack, size_t index)
+{
+    return stack->highWaterMark <= index || _isPoison(&stack->data[index]);
+}
+
+/**
+ * @brief Moves the high-water mark up to the size after a push.
+*/
+template <typename T>
+static inline void _raiseHighWaterMark(Stack<T>* stack)
+{
+    if (stack->highWaterMark < stack->size)
+        stack->highWaterMark = stack->size;
+}
+
+/**
+ * @brief Moves value into an unused slot.
+*/
+template <typename T>
+static inline void _storeSlot(T* slot, T&& value)
+{
+    if constexpr (STACK_TRIVIAL<T>)
+        memcpy((void*)slot, (const void*)&value, sizeof(T));
+    else
+        new (slot) T(std::move(value));
+}
+
+/**
+ * @brief Moves the value out of a slot and leaves the slot unused.
+*/
+template <typename T>
+static inline T _takeSlot(T* slot)
+{
+    T value = std::move(*slot);
+
+    if constexpr (STACK_TRIVIAL<T>)
+        _poisonSlots(slot, 0, 1);
+    else
+        slot->~T();
+
+    return value;
+}
+
+template <typename T>
+static inline bool _isDataInline(const Stack<T>* stack)
+{
+    return (const char*)stack->data - _getDataOffset<T>() == stack->inlineData;
+}
+
+/**
+ * @brief Allocates stack memory from the arena or, without one, from the system.
+*/
+static inline void* _stackMemAlloc(StackArena* arena, size_t size)
+{
+    return arena ? _arenaAlloc(arena, size) : malloc(size);
+}
+
+static inline void* _stackMemRealloc(StackArena* arena, void* block, size_t oldSize, size_t newSize)
+{
+    return arena ? _arenaRealloc(arena, block, oldSize, newSize) : realloc(block, newSize);
+}
+
+static inline void _stackMemFree(StackArena* arena, void* block, size_t size)
+{
+    if (arena)
+        _arenaFree(arena, block, size);
+    else
+        free(block);
+}
+
+template <typename T>
+static void _stackGuardFault(void* stack);
+
+/**
+ * @brief Tells if a data buffer of size bytes should be mapped rather than taken from the heap.
+ *
+ * Guarded stacks are always mapped. Stacks without an arena get a huge pages mapping from
+ * @see STACK_HUGE_PAGES_THRESHOLD bytes and go back to the heap below a quarter of it.
+*/
+template <typename T>
+static inline bool _shouldMapData(const Stack<T>* stack, size_t size)
+{
+    if (stack->guarded)
+        return true;
+
+    if (stack->arena)
+        return false;
+
+    size_t threshold = STACK_HUGE_PAGES_THRESHOLD;
+
+    if (stack->mappedSize)
+        threshold /= STACK_GROW_FACTOR * STACK_GROW_FACTOR;
+
+    return size >= threshold;
+}
+
+/**
+ * @brief Allocates a data buffer, mapped or from @see _stackMemAlloc.
+*/
+template <typename T>
+static inline void* _stackDataAlloc(Stack<T>* stack, size_t size, bool mapped)
+{
+    if (!mapped)
+        return _stackMemAlloc(stack->arena, size);
+
+    if (stack->guarded)
+        return _pagesAlloc(size, (void*)stack, _stackGuardFault<T>);
+
+    return _hugePagesAlloc(size);
+}
+
+/**
+ * @brief Resizes the current data buffer within its kind, mapped buffers are moved by mremap.
+*/
+template <typename T>
+static inline void* _stackDataRealloc(Stack<T>* stack, void* block, size_t oldSize, size_t newSize)
+{
+    if (!stack->mappedSize)
+        return _stackMemRealloc(stack->arena, block, oldSize, newSize);
+
+    if (stack->guarded)
+        return _pagesRealloc(block, stack->mappedSize, newSize);
+
+    return _hugePagesRealloc(block, stack->mappedSize, newSize);
+}
+
+/**
+ * @brief Frees the current data buffer.
+*/
+template <typename T>
+static inline void _stackDataFree(Stack<T>* stack, void* block, size_t size)
+{
+    if (!stack->mappedSize)
+        _stackMemFree(stack->arena, block, size);
+    else if (stack->guarded)
+        _pagesFree(block, stack->mappedSize);
+    else
+        _hugePagesFree(block, stack->mappedSize);
+}
+
+/**
+ * @brief The biggest capacity whose buffer takes as many pages as the buffer of capacity elements.
+*/
+template <typename T>
+static inline size_t _getGuardedCapacity(size_t capacity)
+{
+    return (_roundToPages(_getRealDataSize<T>(capacity)) - _getRealDataSize<T>(0)) / sizeof(T);
+}
+
+#ifdef CANARY_PROTECTION
+template <typename T>
+static ErrorCode _checkCanary(const Stack<T>* stack);
+
+template <typename T>
+static canary_t* _getLeftDataCanaryPtr(const T* data);
+
+template <typename T>
+static canary_t* _getRightDataCanaryPtr(const T* data, size_t realDataSize);
+#endif
+
+#ifdef HASH_PROTECTION
+template <typename T>
+static ErrorCode _checkHash(Stack<T>* stack);
+
+template <typename T>
+static ErrorCode _checkStackHash(Stack<T>* stack);
+
+template <typename T>
+static ErrorCode _reHashify(Stack<T>* stack);
+
+template <typename T>
+static ErrorCode _reallocHashBlocks(Stack<T>* stack, size_t oldCapacity, size_t newCapacity);
+
+static inline size_t _getBlocksCount(size_t capacity);
+
+template <typename T>
+static void _reHashSlot(Stack<T>* stack, size_t index, const T& oldValue, const T& newValue);
+
+template <typename T>
+static void _reHashSlotRange(Stack<T>* stack, size_t from, size_t to, bool add);
+
+template <typename T>
+static hash_t _calculateSlotHash(size_t index, const T& value);
+
+template <typename T>
+static hash_t _calculateDataHash(const Stack<T>* stack);
+
+template <typename T>
+static hash_t _calculateBlockHash(const Stack<T>* stack, size_t block);
+
+template <typename T>
+static hash_t _calculateStackHash(Stack<T>* stack);
+#endif
+
+template <typename T>
+static ErrorCode _checkStackIntegrityFast(Stack<T>* stack);
+
+template <typename T>
+static ErrorCode _checkStackIntegrityUnverified(Stack<T>* stack);
+
+template <typename T>
+static ErrorCode _checkHashBlocks(Stack<T>* stack, size_t from, size_t to, bool verified);
+
+template <typename T>
+static bool _shouldVerify(const Stack<T>* stack);
+
+template <typename T>
+static void _countOperation(Stack<T>* stack, bool verified);
+
+template <typename T>
+static ErrorCode _stackRealloc(Stack<T>* stack);
+
+template <typename T>
+static ErrorCode _stackResize(Stack<T>* stack, size_t newCapacity);
+
+template <typename T>
+static ErrorCode _stackSetCapacity(Stack<T>* stack, size_t newCapacity);
+
+template <typename T>
+static ErrorCode _stackGrowFor(Stack<T>* stack, size_t count);
+
+template <typename T>
+static StackCountResult _pushN(Stack<T>* stack, const T* values, size_t count);
+
+template <typename T>
+static StackCountResult _popN(Stack<T>* stack, T* values, size_t count);
+
+template <typename T>
+static ErrorCode _loadN(Stack<T>* stack, const T* values, size_t count);
+
+template <typename T>
+static ErrorCode _pushUnprotected(Stack<T>* stack, T&& value);
+
+template <typename T>
+static ErrorCode _pushProtected(Stack<T>* stack, T&& value);
+
+template <typename T>
+static StackElementResult<T> _popUnprotected(Stack<T>* stack);
+
+template <typename T>
+static StackElementResult<T> _popProtected(Stack<T>* stack);
+
+template <typename T>
+static inline void _beginWrite(Stack<T>* stack);
+
+template <typename T>
+static inline void _endWrite(Stack<T>* stack);
+
+template <typename T>
+static ErrorCode _auditStack(Stack<T>* stack);
+
+template <typename T>
+static ErrorCode _auditStackHeader(Stack<T>* stack);
+
+template <typename T>
+static ErrorCode _auditStackBlock(Stack<T>* stack, size_t block);
+
+template <typename T>
+static ErrorCode _auditStackErased(void* stack);
+
+template <typename T>
+static ErrorCode _stackDumpErased(FILE* where, void* stack, SourceCodePosition* caller, ErrorCode error);
+
+template <typename T>
+static ErrorCode _stackDumpBinary(FILE* where, Stack<T>* stack, SourceCodePosition* caller, ErrorCode error);
+
+template <typename T>
+StackResult<T> _stackInitGuarded(SourceCodePosition* origin, StackProtection protection)
+{
+    return _stackInit<T>(origin, protection, NULL, true);
+}
+
+template <typename T>
+StackResult<T> _stackInit(SourceCodePosition* origin, StackProtection protection, StackArena* arena, bool guarded)
+{
+    Stack<T>* stack = (Stack<T>*)(arena ? _arenaAlloc(arena, sizeof(Stack<T>))
+                                        : aligned_alloc(alignof(Stack<T>), sizeof(Stack<T>)));
+
+    if (!stack)
+        return {NULL, ERROR_NO_MEMORY};
+
+    if (!STACK_TRIVIAL<T> && protection > STACK_PROTECTION_CANARY)
+        protection = STACK_PROTECTION_CANARY;
+
+    *stack =
+    {
+        #ifdef CANARY_PROTECTION
+            .leftCanary = _CANARY,
+        #endif
+        .origin = *origin,
+        .size = 0,
+        .capacity = DEFAULT_CAPACITY,
+        .growthPolicy = DEFAULT_GROWTH_POLICY,
+        .protection = protection,
+        .verifyPeriod = DEFAULT_VERIFY_PERIOD,
+        .arena = arena,
+        .guarded = guarded
+        #ifdef CANARY_PROTECTION
+            ,.rightCanary = _CANARY
+        #endif
+    };
+
+    #ifdef STACK_STATS
+    _statsAttach(&stack->stats);
+    #endif
+
+    if (guarded)
+        stack->capacity = _getGuardedCapacity<T>(DEFAULT_CAPACITY);
+
+    size_t realDataSize = _getRealDataSize<T>(stack->capacity);
+
+    bool mapped = guarded || (stack->capacity > STACK_INLINE_CAPACITY && _shouldMapData(stack, realDataSize));
+
+    char* buffer = !guarded && stack->capacity <= STACK_INLINE_CAPACITY ? stack->inlineData
+                                                                        : (char*)_stackDataAlloc(stack, realDataSize, mapped);
+
+    if (buffer && mapped)
+        stack->mappedSize = _roundToPages(realDataSize);
+
+    ErrorCode error = EVERYTHING_FINE;
+    if (!buffer)
+    {
+        error = ERROR_NO_MEMORY;
+        stack->capacity = 0;
+        realDataSize = 0;
+    }
+    else if (!mapped)
+        memset(buffer, 0, realDataSize);
+
+    T* data = buffer ? (T*)(buffer + _getDataOffset<T>()) : NULL;
+
+    #ifdef CANARY_PROTECTION
+    if (data)
+    {
+        *_getLeftDataCanaryPtr(data) = _CANARY;
+        *_getRightDataCanaryPtr(data, realDataSize) = _CANARY;
+    }
+    #endif
+
+    stack->data = data;
+    stack->realDataSize = realDataSize;
+
+    _poisonNewSlots(stack, 0, stack->capacity);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        if (!error)
+            error = _reallocHashBlocks(stack, 0, stack->capacity);
+
+        _reHashify(stack);
+    }
+    #endif
+
+    return {stack, error};
+}
+
+template <typename T>
+ErrorCode StackDestructor(Stack<T>* stack)
+{
+    ErrorCode error = CheckStackIntegrity(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    if (stack->audited)
+        StackAuditUnregister(stack);
+
+    #ifdef STACK_STATS
+    _statsDetach(&stack->stats);
+    #endif
+
+    if (stack->data == NULL)
+        error = ERROR_NO_MEMORY;
+    else
+    {
+        if constexpr (!STACK_TRIVIAL<T>)
+            for (size_t i = 0; i < stack->size; i++)
+                stack->data[i].~T();
+
+        if (!_isDataInline(stack))
+            _stackDataFree(stack, (char*)stack->data - _getDataOffset<T>(), stack->realDataSize);
+    }
+
+    #ifdef HASH_PROTECTION
+        if (stack->hashBlocks && stack->hashBlocks != &stack->inlineHashBlock)
+            _stackMemFree(stack->arena, stack->hashBlocks, stack->hashBlocksAllocated * sizeof(hash_t));
+        stack->hashBlocks = NULL;
+        stack->hashData = (hash_t)SIZET_POISON;
+        stack->hashStack = (hash_t)SIZET_POISON;
+    #endif
+
+    stack->size = SIZET_POISON;
+    stack->capacity = SIZET_POISON;
+    stack->highWaterMark = SIZET_POISON;
+
+    stack->data = NULL;
+
+    stack->origin = {};
+
+    #ifdef CANARY_PROTECTION
+        stack->leftCanary = SIZET_POISON;
+        stack->rightCanary = SIZET_POISON;
+    #endif
+
+    _stackMemFree(stack->arena, (void*)stack, sizeof(Stack<T>));
+
+    return error;
+}
+
+template <typename T>
+ErrorCode CheckStackIntegrity(Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    _STACK_STATS_ADD(stack, integrityChecks, 1);
+
+    if (stack->capacity < stack->highWaterMark || stack->highWaterMark < stack->size)
+        return ERROR_INDEX_OUT_OF_BOUNDS;
+    if (!stack->data)
+        return ERROR_NO_MEMORY;
+
+    #ifdef CANARY_PROTECTION
+    if (_isCanaryOn(stack))
+    {
+        ErrorCode canaryError = _STACK_STATS_TIMED(stack, canaryCheckCycles, _checkCanary(stack));
+        _STACK_DUMP_ERROR_DEBUG(stack, canaryError);
+        RETURN_ERROR(canaryError);
+    }
+    #endif
+
+    #ifdef POISON_PROTECTION
+    if constexpr (STACK_TRIVIAL<T>)
+        if (_isPoisonOn(stack))
+        {
+            ErrorCode poisonError = CheckStackPoison(stack);
+            _STACK_DUMP_ERROR_DEBUG(stack, poisonError);
+            RETURN_ERROR(poisonError);
+        }
+    #endif
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        ErrorCode error = _STACK_STATS_TIMED(stack, hashCheckCycles, _checkHash(stack));
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+        RETURN_ERROR(error);
+    }
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode CheckStackPoison(Stack<T>* stack)
+{
+    static_assert(STACK_TRIVIAL<T>, "Only trivially copyable elements are poisoned");
+
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    if (stack->capacity < stack->highWaterMark || stack->highWaterMark < stack->size)
+        return ERROR_INDEX_OUT_OF_BOUNDS;
+    if (!stack->data)
+        return ERROR_NO_MEMORY;
+
+    T poison = _getPoison<T>();
+    size_t unused = stack->highWaterMark - stack->size;
+
+    if (_findPatternMismatch((const void*)(stack->data + stack->size), (const void*)&poison, sizeof(T), unused) != unused)
+        return ERROR_BAD_POISON;
+
+    return EVERYTHING_FINE;
+}
+
+/**
+ * @brief Checks everything but the data hash in O(1).
+ *
+ * Used on the Push/Pop path: the data hash is kept up to date incrementally
+ * and fully recalculated only by @see CheckStackIntegrity,
+ * unless the stack is @see STACK_PROTECTION_PARANOID.
+ *
+ * @param [in] stack - the stack to check.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+static ErrorCode _checkStackIntegrityFast(Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    if (stack->protection == STACK_PROTECTION_PARANOID)
+        return CheckStackIntegrity(stack);
+
+    _STACK_STATS_ADD(stack, fastIntegrityChecks, 1);
+
+    if (stack->capacity < stack->highWaterMark || stack->highWaterMark < stack->size)
+        return ERROR_INDEX_OUT_OF_BOUNDS;
+    if (!stack->data)
+        return ERROR_NO_MEMORY;
+
+    #ifdef CANARY_PROTECTION
+    if (_isCanaryOn(stack))
+    {
+        ErrorCode canaryError = _STACK_STATS_TIMED(stack, canaryCheckCycles, _checkCanary(stack));
+        _STACK_DUMP_ERROR_DEBUG(stack, canaryError);
+        RETURN_ERROR(canaryError);
+    }
+    #endif
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        ErrorCode error = _STACK_STATS_TIMED(stack, hashCheckCycles, _checkStackHash(stack));
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+        RETURN_ERROR(error);
+    }
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+/**
+ * @brief Checks the stack hash before an operation that does not verify the stack.
+ *
+ * Every protected operation signs the header again when it is done, so the header
+ * must be checked first, or a corruption since the last verification would get a valid hash.
+ * It is O(1) and not sampled, only the rest of @see _checkStackIntegrityFast is.
+ *
+ * @param [in] stack - the stack to check.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+static ErrorCode _checkStackIntegrityUnverified(Stack<T>* stack)
+{
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        return _STACK_STATS_TIMED(stack, hashCheckCycles, _checkStackHash(stack));
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+/**
+ * @brief Checks the hash blocks holding slots [from, to) before they are popped.
+ *
+ * Costs @see STACK_HASH_BLOCK_SIZE slot hashes per block, so a popped element corrupted
+ * in memory is caught without rehashing the whole stack. Skipped after a verification of
+ * a @see STACK_PROTECTION_PARANOID stack, which has just checked every block.
+ *
+ * @param [in] stack - the stack to check.
+ * @param [in] from - first popped slot.
+ * @param [in] to - slot after the last popped one.
+ * @param [in] verified - whether the operation has verified the stack.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+static ErrorCode _checkHashBlocks(Stack<T>* stack, size_t from, size_t to, bool verified)
+{
+    #ifdef HASH_PROTECTION
+    if (!_isHashOn(stack) || (verified && stack->protection == STACK_PROTECTION_PARANOID))
+        return EVERYTHING_FINE;
+
+    for (size_t block = from / STACK_HASH_BLOCK_SIZE; block * STACK_HASH_BLOCK_SIZE < to; block++)
+        if (stack->hashBlocks[block] != _STACK_STATS_TIMED(stack, hashCheckCycles, _calculateBlockHash(stack, block)))
+            return ERROR_BAD_HASH;
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode StackSetVerification(Stack<T>* stack, size_t period, uint64_t intervalNs)
+{
+    ErrorCode error = _checkStackIntegrityFast(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    _beginWrite(stack);
+
+    stack->verifyPeriod = period;
+    stack->verifyIntervalNs = intervalNs;
+    stack->lastVerifiedNs = intervalNs ? _getTimeNs() : 0;
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    _endWrite(stack);
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode StackCheckpoint(Stack<T>* stack)
+{
+    ErrorCode error = CheckStackIntegrity(stack);
+    RETURN_ERROR(error);
+
+    _beginWrite(stack);
+
+    stack->opsSinceVerified = 0;
+    if (stack->verifyIntervalNs)
+        stack->lastVerifiedNs = _getTimeNs();
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    _endWrite(stack);
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode StackAuditRegister(Stack<T>* stack)
+{
+    ErrorCode error = CheckStackIntegrity(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    if (stack->audited)
+        return EVERYTHING_FINE;
+
+    pthread_mutex_lock(&_AUDIT_MUTEX);
+
+    error = _auditAdd((void*)stack, _auditStackErased<T>, _stackDumpErased<T>);
+
+    if (!error)
+    {
+        stack->audited = true;
+        stack->verifyPeriod = 0;
+        stack->verifyIntervalNs = 0;
+        stack->opsSinceVerified = 0;
+
+        #ifdef HASH_PROTECTION
+        if (_isHashOn(stack))
+            stack->hashStack = _calculateStackHash(stack);
+        #endif
+    }
+
+    pthread_mutex_unlock(&_AUDIT_MUTEX);
+
+    return error;
+}
+
+template <typename T>
+ErrorCode StackAuditUnregister(Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    pthread_mutex_lock(&_AUDIT_MUTEX);
+
+    ErrorCode error = _auditRemove((void*)stack);
+
+    if (!error)
+    {
+        #ifdef HASH_PROTECTION
+        // A corrupted header is not signed again, so that the corruption is still caught
+        bool signHeader = _isHashOn(stack) && _checkStackHash(stack) == EVERYTHING_FINE;
+        #endif
+
+        stack->audited = false;
+
+        #ifdef HASH_PROTECTION
+        if (signHeader)
+            stack->hashStack = _calculateStackHash(stack);
+        #endif
+    }
+
+    pthread_mutex_unlock(&_AUDIT_MUTEX);
+
+    return error;
+}
+
+template <typename T>
+ErrorCode CheckStackBlocks(Stack<T>* stack, size_t firstBlock, size_t numOfBlocks)
+{
+    ErrorCode error = _checkStackIntegrityFast(stack);
+    RETURN_ERROR(error);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        size_t lastBlock = min(firstBlock + numOfBlocks, _getBlocksCount(stack->capacity));
+
+        for (size_t block = firstBlock; block < lastBlock; block++)
+            if (stack->hashBlocks[block] != _calculateBlockHash(stack, block))
+            {
+                _STACK_DUMP_ERROR_DEBUG(stack, ERROR_BAD_HASH);
+                return ERROR_BAD_HASH;
+            }
+    }
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+size_t StackBlocksCount(Stack<T>* stack)
+{
+    if (!stack || !_isHashOn(stack))
+        return 0;
+
+    return (stack->capacity + STACK_HASH_BLOCK_SIZE - 1) / STACK_HASH_BLOCK_SIZE;
+}
+
+template <typename T>
+ErrorCode StackSetGrowthPolicy(Stack<T>* stack, StackGrowthPolicy policy)
+{
+    ErrorCode error = _checkStackIntegrityFast(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    if (policy.growFactor < 2 || policy.shrinkDivisor <= policy.growFactor || policy.minCapacity == 0)
+        return ERROR_BAD_VALUE;
+
+    _beginWrite(stack);
+
+    stack->growthPolicy = policy;
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    _endWrite(stack);
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode StackReserve(Stack<T>* stack, size_t capacity)
+{
+    ErrorCode error = _checkStackIntegrityFast(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    _beginWrite(stack);
+
+    stack->reservedCapacity = capacity;
+
+    if (capacity > stack->capacity)
+        error = _stackSetCapacity(stack, capacity);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    _endWrite(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+    return error;
+}
+
+template <typename T>
+ErrorCode StackShrinkToFit(Stack<T>* stack)
+{
+    ErrorCode error = _checkStackIntegrityFast(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    _beginWrite(stack);
+
+    stack->reservedCapacity = 0;
+
+    size_t newCapacity = max(stack->size, stack->growthPolicy.minCapacity);
+
+    if (newCapacity < stack->capacity)
+        error = _stackSetCapacity(stack, newCapacity);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    _endWrite(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+    return error;
+}
+
+template <typename T>
+size_t StackReallocationsCount(Stack<T>* stack)
+{
+    if (!stack)
+        return 0;
+
+    return stack->reallocations;
+}
+
+template <typename T>
+StackStats StackGetStats(Stack<T>* stack)
+{
+    if (!stack)
+        return {};
+
+    #ifdef STACK_STATS
+    return _statsLoad(&stack->stats.counters);
+    #else
+    return {};
+    #endif
+}
+
+template <typename T>
+ErrorCode StackSave(Stack<T>* stack, const char* path)
+{
+    static_assert(STACK_TRIVIAL<T>, "Elements are saved bytewise, T must be trivially copyable");
+
+    MyAssertSoft(path, ERROR_NULLPTR);
+
+    ErrorCode error = _checkStackIntegrityFast(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    return _stackFileWrite(path, stack->data, sizeof(T), stack->size);
+}
+
+template <typename T>
+ErrorCode StackLoad(Stack<T>* stack, const char* path)
+{
+    static_assert(STACK_TRIVIAL<T>, "Elements are loaded bytewise, T must be trivially copyable");
+
+    MyAssertSoft(stack, ERROR_NULLPTR);
+    MyAssertSoft(path, ERROR_NULLPTR);
+
+    _StackFileMapping file = {};
+
+    RETURN_ERROR(_stackFileMap(path, sizeof(T), &file));
+
+    _beginWrite(stack);
+
+    ErrorCode error = _loadN(stack, (const T*)file.data, file.size);
+
+    _endWrite(stack);
+
+    _stackFileUnmap(&file);
+
+    return error;
+}
+
+template <typename T>
+ErrorCode _stackDump(FILE* where, Stack<T>* stack, SourceCodePosition* caller, ErrorCode error)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+    MyAssertSoft(caller, ERROR_NULLPTR);
+
+    MyAssertSoft(where, ERROR_BAD_FILE);
+
+    if constexpr (STACK_TRIVIAL<T>)
+        if (__atomic_load_n(&_DUMP_FORMAT, __ATOMIC_RELAXED) == STACK_DUMP_BINARY)
+            return _stackDumpBinary(where, stack, caller, error);
+
+    const size_t maxStackValues = 4096;
+
+    fprintf(where, "Stack[%p] from %s(%zu) %s()\n", stack, stack->origin.fileName, stack->origin.line, stack->origin.name);
+    fprintf(where, "called from %s(%zu) %s()\n", caller->fileName, caller->line, caller->name);
+    fprintf(where, "Stack condition - %s\n", ERROR_CODE_NAMES[error]);
+    fprintf(where, "Stack protection - %s\n", STACK_PROTECTION_NAMES[stack->protection]);
+    fprintf(where, "Operations since last verification = %zu\n", stack->opsSinceVerified);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        uint dataHash  = _calculateDataHash(stack);
+        uint stackHash = _calculateStackHash(stack);
+
+        fprintf(where, "Data hash = %u", stack->hashData);
+        if (stack->hashData != dataHash)
+            fprintf(where, " INVALID!!! SHOULD BE %u", dataHash);
+        fprintf(where, "\n");
+
+        size_t blocksCount = stack->hashBlocks ? _getBlocksCount(stack->capacity) : 0;
+        for (size_t block = 0; block < blocksCount; block++)
+        {
+            hash_t blockHash = _calculateBlockHash(stack, block);
+
+            if (stack->hashBlocks[block] != blockHash)
+                fprintf(where, "Data block %zu [%zu, %zu) hash = %u INVALID!!! SHOULD BE %u\n",
+                        block, block * STACK_HASH_BLOCK_SIZE,
+                        min((block + 1) * STACK_HASH_BLOCK_SIZE, stack->capacity),
+                        stack->hashBlocks[block], blockHash);
+        }
+
+        fprintf(where, "Stack hash = %u", stack->hashStack);
+        if (stack->hashStack != stackHash)
+            fprintf(where, " INVALID!!! SHOULD BE %u", stackHash);
+        fprintf(where, "\n");
+    }
+    #endif
+
+    #ifdef CANARY_PROTECTION
+    if (_isCanaryOn(stack))
+    {
+        fprintf(where, "Left stack canary = %zu", stack->leftCanary);
+        if (stack->leftCanary != _CANARY)
+            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+        fprintf(where, "\n");
+
+        fprintf(where, "Right stack canary = %zu", stack->rightCanary);
+        if (stack->rightCanary != _CANARY)
+            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+        fprintf(where, "\n");
+    }
+    #endif
+
+    fprintf(where, "{\n");
+    fprintf(where, "    size = %zu\n", stack->size);
+    fprintf(where, "    capacity = %zu\n", stack->capacity);
+    fprintf(where, "    high-water mark = %zu\n", stack->highWaterMark);
+    fprintf(where, "    reserved capacity = %zu\n", stack->reservedCapacity);
+    fprintf(where, "    reallocations = %zu\n", stack->reallocations);
+    fprintf(where, "    growth policy = {grow factor = %zu, shrink divisor = %zu, min capacity = %zu%s}\n",
+            stack->growthPolicy.growFactor, stack->growthPolicy.shrinkDivisor, stack->growthPolicy.minCapacity,
+            stack->growthPolicy.noShrink ? ", no shrink" : "");
+    fprintf(where, "    data[%p]%s\n", stack->data, stack->guarded   ? " between guard pages" :
+                                                 stack->mappedSize ? " in huge pages"       : "");
+    if (stack->mappedSize)
+        fprintf(where, "    mapped size = %zu\n", stack->mappedSize);
+
+    #ifdef CANARY_PROTECTION
+    if (_isCanaryOn(stack))
+    {
+        canary_t leftDataCanary = *_getLeftDataCanaryPtr(stack->data);
+        fprintf(where, "    Left data canary = %zu", leftDataCanary);
+        if (leftDataCanary != _CANARY)
+            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+        fprintf(where, "\n");
+    }
+    #endif
+
+    const T* data = stack->data;
+    size_t numOfElements = min(stack->capacity, maxStackValues);
+
+    for (size_t i = 0; i < numOfElements; i++)
+    {
+        fprintf(where, "    ");
+
+        bool poisoned = STACK_TRIVIAL<T> ? _isSlotPoisoned(stack, i) : stack->size <= i;
+
+        if (!poisoned)
+        {
+            fprintf(where, "*[%zu] = ", i);
+            StackTraits<T>::Print(where, data[i]);
+            fprintf(where, "\n");
+        }
+        else
+            fprintf(where, " [%zu] = POISON\n", i);
+    }
+
+    #ifdef CANARY_PROTECTION
+    if (_isCanaryOn(stack))
+    {
+        canary_t rightDataCanary = *_getRightDataCanaryPtr(stack->data, stack->realDataSize);
+        fprintf(where, "    Right data canary = %zu", rightDataCanary);
+        if (rightDataCanary != _CANARY)
+            fprintf(where, " INVALID!!! SHOULD BE %zu", _CANARY);
+        fprintf(where, "\n");
+    }
+    #endif
+
+    fprintf(where, "}\n\n\n");
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode Push(Stack<T>* stack, T value)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    _beginWrite(stack);
+
+    ErrorCode error = stack->protection == STACK_PROTECTION_NONE ? _pushUnprotected(stack, std::move(value))
+                                                                 : _pushProtected(stack, std::move(value));
+
+    _endWrite(stack);
+
+    return error;
+}
+
+template <typename T>
+StackElementResult<T> Pop(Stack<T>* stack)
+{
+    MyAssertSoftResult(stack, _getPoison<T>(), ERROR_NULLPTR);
+
+    _beginWrite(stack);
+
+    StackElementResult<T> result = stack->protection == STACK_PROTECTION_NONE ? _popUnprotected(stack)
+                                                                              : _popProtected(stack);
+
+    _endWrite(stack);
+
+    return result;
+}
+
+template <typename T>
+StackCountResult PushN(Stack<T>* stack, const T* values, size_t count)
+{
+    MyAssertSoftResult(stack, 0, ERROR_NULLPTR);
+    MyAssertSoftResult(values || count == 0, 0, ERROR_NULLPTR);
+
+    _beginWrite(stack);
+
+    StackCountResult result = _pushN(stack, values, count);
+
+    _endWrite(stack);
+
+    return result;
+}
+
+template <typename T>
+StackCountResult PopN(Stack<T>* stack, T* values, size_t count)
+{
+    MyAssertSoftResult(stack, 0, ERROR_NULLPTR);
+    MyAssertSoftResult(values || count == 0, 0, ERROR_NULLPTR);
+
+    _beginWrite(stack);
+
+    StackCountResult result = _popN(stack, values, count);
+
+    _endWrite(stack);
+
+    return result;
+}
+
+template <typename T>
+StackCountResult PeekN(Stack<T>* stack, T* values, size_t count)
+{
+    MyAssertSoftResult(stack, 0, ERROR_NULLPTR);
+    MyAssertSoftResult(values || count == 0, 0, ERROR_NULLPTR);
+
+    if (stack->protection != STACK_PROTECTION_NONE)
+    {
+        ErrorCode error = _checkStackIntegrityFast(stack);
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+        if (error)
+            return {0, error};
+    }
+
+    size_t peeked = min(count, stack->size);
+    const T* top = stack->data + stack->size - peeked;
+
+    if constexpr (STACK_TRIVIAL<T>)
+        memcpy((void*)values, (const void*)top, peeked * sizeof(T));
+    else
+        for (size_t i = 0; i < peeked; i++)
+            values[i] = top[i];
+
+    return {peeked, peeked < count ? ERROR_INDEX_OUT_OF_BOUNDS : EVERYTHING_FINE};
+}
+
+template <typename T>
+static StackCountResult _pushN(Stack<T>* stack, const T* values, size_t count)
+{
+    bool verify = stack->protection != STACK_PROTECTION_NONE && _shouldVerify(stack);
+
+    ErrorCode error = EVERYTHING_FINE;
+
+    if (stack->protection != STACK_PROTECTION_NONE)
+    {
+        error = verify ? _checkStackIntegrityFast(stack) : _checkStackIntegrityUnverified(stack);
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+        if (error)
+            return {0, error};
+    }
+
+    // Values may be elements of the stack itself, they move with its buffer
+    const T* oldData = stack->data;
+    bool ownValues = (uintptr_t)values >= (uintptr_t)oldData && (uintptr_t)values < (uintptr_t)(oldData + stack->size);
+
+    error = _stackGrowFor(stack, count);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+    if (error)
+        return {0, error};
+
+    if (ownValues)
+        values = stack->data + (values - oldData);
+
+    size_t pushed = count;
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        for (size_t i = 0; i < count; i++)
+        {
+            if (!_isSlotPoisoned(stack, stack->size + i))
+            {
+                pushed = i;
+                error = ERROR_BAD_HASH;
+                break;
+            }
+            _reHashSlot(stack, stack->size + i, _getPoison<T>(), values[i]);
+        }
+    #endif
+
+    if constexpr (STACK_TRIVIAL<T>)
+        memcpy((void*)(stack->data + stack->size), (const void*)values, pushed * sizeof(T));
+    else
+        for (size_t i = 0; i < pushed; i++)
+            new (&stack->data[stack->size + i]) T(values[i]);
+
+    stack->size += pushed;
+
+    _raiseHighWaterMark(stack);
+
+    _STACK_STATS_ADD(stack, pushes, pushed);
+    _STACK_STATS_MAX(stack, maxDepth, stack->size);
+
+    if (stack->protection == STACK_PROTECTION_NONE)
+        return {pushed, error};
+
+    _countOperation(stack, verify);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    #ifdef CANARY_PROTECTION
+    if (!error && verify && _isCanaryOn(stack))
+        error = _STACK_STATS_TIMED(stack, canaryCheckCycles, _checkCanary(stack));
+    #endif
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+    return {pushed, error};
+}
+
+/**
+ * @brief @see _pushN for a whole file, copies the elements at once and hashes every one of them once.
+*/
+template <typename T>
+static ErrorCode _loadN(Stack<T>* stack, const T* values, size_t count)
+{
+    bool verify = stack->protection != STACK_PROTECTION_NONE && _shouldVerify(stack);
+
+    ErrorCode error = EVERYTHING_FINE;
+
+    if (stack->protection != STACK_PROTECTION_NONE)
+    {
+        error = verify ? _checkStackIntegrityFast(stack) : _checkStackIntegrityUnverified(stack);
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+        RETURN_ERROR(error);
+    }
+
+    error = _stackGrowFor(stack, count);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    size_t from = stack->size;
+    size_t to   = stack->size + count;
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        for (size_t i = from; i < to; i++)
+            if (!_isSlotPoisoned(stack, i))
+            {
+                _STACK_DUMP_ERROR_DEBUG(stack, ERROR_BAD_HASH);
+                return ERROR_BAD_HASH;
+            }
+    #endif
+
+    memcpy((void*)(stack->data + from), (const void*)values, count * sizeof(T));
+
+    stack->size = to;
+
+    _raiseHighWaterMark(stack);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        T poison = _getPoison<T>();
+
+        for (size_t block = from / STACK_HASH_BLOCK_SIZE; block * STACK_HASH_BLOCK_SIZE < to; block++)
+        {
+            size_t firstSlot = block * STACK_HASH_BLOCK_SIZE;
+            size_t lastSlot  = min(firstSlot + STACK_HASH_BLOCK_SIZE, stack->capacity);
+
+            hash_t delta = 0;
+
+            // Blocks loaded whole are hashed from scratch, the edge ones slot by slot
+            if (from <= firstSlot && lastSlot <= to)
+                delta = _calculateBlockHash(stack, block) - stack->hashBlocks[block];
+            else
+                for (size_t i = max(from, firstSlot); i < min(to, lastSlot); i++)
+                    delta += _calculateSlotHash(i, stack->data[i]) - _calculateSlotHash(i, poison);
+
+            stack->hashBlocks[block] += delta;
+            stack->hashData += delta;
+        }
+    }
+    #endif
+
+    _STACK_STATS_ADD(stack, pushes, count);
+    _STACK_STATS_MAX(stack, maxDepth, stack->size);
+
+    if (stack->protection == STACK_PROTECTION_NONE)
+        return EVERYTHING_FINE;
+
+    _countOperation(stack, verify);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    #ifdef CANARY_PROTECTION
+    if (verify && _isCanaryOn(stack))
+        error = _STACK_STATS_TIMED(stack, canaryCheckCycles, _checkCanary(stack));
+    #endif
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+    return error;
+}
+
+template <typename T>
+static StackCountResult _popN(Stack<T>* stack, T* values, size_t count)
+{
+    bool verify = stack->protection != STACK_PROTECTION_NONE && _shouldVerify(stack);
+
+    ErrorCode error = EVERYTHING_FINE;
+
+    if (stack->protection != STACK_PROTECTION_NONE)
+    {
+        error = verify ? _checkStackIntegrityFast(stack) : _checkStackIntegrityUnverified(stack);
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+        if (error)
+            return {0, error};
+    }
+
+    size_t popped = min(count, stack->size);
+    size_t newSize = stack->size - popped;
+
+    if (stack->protection != STACK_PROTECTION_NONE)
+    {
+        error = _checkHashBlocks(stack, newSize, stack->size, verify);
+
+        _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+        if (error)
+            return {0, error};
+    }
+
+    if (popped < count)
+        error = ERROR_INDEX_OUT_OF_BOUNDS;
+
+    if constexpr (STACK_TRIVIAL<T>)
+    {
+        memcpy((void*)values, (const void*)(stack->data + newSize), popped * sizeof(T));
+
+        #ifdef HASH_PROTECTION
+        if (_isHashOn(stack))
+            for (size_t i = newSize; i < stack->size; i++)
+                _reHashSlot(stack, i, stack->data[i], _getPoison<T>());
+        #endif
+
+        _poisonSlots(stack->data, newSize, stack->size);
+    }
+    else
+        for (size_t i = newSize; i < stack->size; i++)
+            values[i - newSize] = _takeSlot(&stack->data[i]);
+
+    stack->size = newSize;
+
+    _STACK_STATS_ADD(stack, pops, popped);
+
+    size_t newCapacity = stack->capacity;
+
+    while (stack->size < newCapacity)
+    {
+        size_t shrunkCapacity = _getNewCapacity(stack->size, newCapacity, &stack->growthPolicy, stack->reservedCapacity);
+
+        if (shrunkCapacity == 0)
+            break;
+
+        newCapacity = shrunkCapacity;
+    }
+
+    ErrorCode reallocError = EVERYTHING_FINE;
+    if (newCapacity != stack->capacity)
+        reallocError = _stackSetCapacity(stack, newCapacity);
+
+    if (stack->protection == STACK_PROTECTION_NONE)
+        return {popped, reallocError ? reallocError : error};
+
+    _countOperation(stack, verify);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    if (reallocError)
+        error = reallocError;
+
+    #ifdef CANARY_PROTECTION
+    if (!error && verify && _isCanaryOn(stack))
+        error = _STACK_STATS_TIMED(stack, canaryCheckCycles, _checkCanary(stack));
+    #endif
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+    return {popped, error};
+}
+
+template <typename T>
+static ErrorCode _pushUnprotected(Stack<T>* stack, T&& value)
+{
+    if (stack->size == stack->capacity)
+        RETURN_ERROR(_stackRealloc(stack));
+
+    _storeSlot(&stack->data[stack->size++], std::move(value));
+
+    _raiseHighWaterMark(stack);
+
+    _STACK_STATS_ADD(stack, pushes, 1);
+    _STACK_STATS_MAX(stack, maxDepth, stack->size);
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+static StackElementResult<T> _popUnprotected(Stack<T>* stack)
+{
+    if (stack->size == 0)
+        return {_getPoison<T>(), ERROR_INDEX_OUT_OF_BOUNDS};
+
+    T value = _takeSlot(&stack->data[--stack->size]);
+
+    _STACK_STATS_ADD(stack, pops, 1);
+
+    ErrorCode error = _stackRealloc(stack);
+
+    return {std::move(value), error};
+}
+
+template <typename T>
+static ErrorCode _pushProtected(Stack<T>* stack, T&& value)
+{
+    bool verify = _shouldVerify(stack);
+
+    ErrorCode error = verify ? _checkStackIntegrityFast(stack) : _checkStackIntegrityUnverified(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    error = _stackRealloc(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    RETURN_ERROR(error);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        if (!_isSlotPoisoned(stack, stack->size))
+        {
+            _STACK_DUMP_ERROR_DEBUG(stack, ERROR_BAD_HASH);
+            return ERROR_BAD_HASH;
+        }
+        _reHashSlot(stack, stack->size, _getPoison<T>(), value);
+    }
+    #endif
+
+    _storeSlot(&stack->data[stack->size++], std::move(value));
+
+    _raiseHighWaterMark(stack);
+
+    _STACK_STATS_ADD(stack, pushes, 1);
+    _STACK_STATS_MAX(stack, maxDepth, stack->size);
+
+    _countOperation(stack, verify);
+
+    #ifdef CANARY_PROTECTION
+    if (verify && _isCanaryOn(stack))
+    {
+        ErrorCode canaryError = _STACK_STATS_TIMED(stack, canaryCheckCycles, _checkCanary(stack));
+        _STACK_DUMP_ERROR_DEBUG(stack, canaryError);
+        RETURN_ERROR(canaryError);
+    }
+    #endif
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+static StackElementResult<T> _popProtected(Stack<T>* stack)
+{
+    bool verify = _shouldVerify(stack);
+
+    ErrorCode error = verify ? _checkStackIntegrityFast(stack) : _checkStackIntegrityUnverified(stack);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+    if (error)
+        return {_getPoison<T>(), error};
+
+    if (stack->size == 0)
+        return {_getPoison<T>(), ERROR_INDEX_OUT_OF_BOUNDS};
+
+    error = _checkHashBlocks(stack, stack->size - 1, stack->size, verify);
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+
+    if (error)
+        return {_getPoison<T>(), error};
+
+    stack->size--;
+
+    T value = _takeSlot(&stack->data[stack->size]);
+
+    _STACK_STATS_ADD(stack, pops, 1);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        _reHashSlot(stack, stack->size, value, _getPoison<T>());
+    #endif
+
+    error = _stackRealloc(stack);
+
+    _countOperation(stack, verify);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+        stack->hashStack = _calculateStackHash(stack);
+    #endif
+
+    _STACK_DUMP_ERROR_DEBUG(stack, error);
+    if (error)
+        return {std::move(value), error};
+
+    #ifdef CANARY_PROTECTION
+    if (verify && _isCanaryOn(stack))
+    {
+        ErrorCode canaryError = _STACK_STATS_TIMED(stack, canaryCheckCycles, _checkCanary(stack));
+        _STACK_DUMP_ERROR_DEBUG(stack, canaryError);
+        if (canaryError)
+            return {_getPoison<T>(), canaryError};
+    }
+    #endif
+
+    return {std::move(value), error};
+}
+
+/**
+ * @brief Tells the capacity a buffer of size elements should have, @see StackGrowthPolicy.
+ *
+ * It increases capacity in growFactor if size == capacity.
+ * It shrinks it in growFactor if size <= capacity / shrinkDivisor,
+ * but not below minCapacity and reserved.
+ *
+ * @param [in] size - number of elements.
+ * @param [in] capacity - current capacity.
+ * @param [in] policy - the growth policy.
+ * @param [in] reserved - capacity not to shrink below.
+ *
+ * @return new capacity or 0 if it should not change.
+*/
+static inline size_t _getNewCapacity(size_t size, size_t capacity, const StackGrowthPolicy* policy, size_t reserved = 0)
+{
+    if (size == capacity)
+        return capacity * policy->growFactor;
+
+    size_t minCapacity = max(policy->minCapacity, reserved);
+
+    if (!policy->noShrink && minCapacity < capacity && size <= capacity / policy->shrinkDivisor)
+        return max(capacity / policy->growFactor, minCapacity);
+
+    return 0;
+}
+
+/**
+ * @brief Performs stack reallocation if needed, @see _getNewCapacity.
+ *
+ * @param [in] stack - to resize.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+static ErrorCode _stackRealloc(Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    size_t newCapacity = _getNewCapacity(stack->size, stack->capacity, &stack->growthPolicy, stack->reservedCapacity);
+
+    if (newCapacity == 0)
+        return EVERYTHING_FINE;
+
+    return _stackSetCapacity(stack, newCapacity);
+}
+
+/**
+ * @brief Grows the stack by its growth policy until count more elements fit.
+ *
+ * @return @see ErrorCode, ERROR_NO_MEMORY if the capacity would not fit in size_t.
+*/
+template <typename T>
+static ErrorCode _stackGrowFor(Stack<T>* stack, size_t count)
+{
+    if (count <= stack->capacity - stack->size)
+        return EVERYTHING_FINE;
+
+    const size_t maxCapacity = (SIZE_MAX - _getRealDataSize<T>(0)) / sizeof(T) - sizeof(canary_t);
+
+    if (count > maxCapacity - stack->size)
+        return ERROR_NO_MEMORY;
+
+    size_t neededCapacity = stack->size + count;
+    size_t newCapacity = stack->capacity ? stack->capacity : DEFAULT_CAPACITY;
+
+    while (newCapacity < neededCapacity)
+    {
+        if (newCapacity > maxCapacity / stack->growthPolicy.growFactor)
+        {
+            newCapacity = neededCapacity;
+            break;
+        }
+
+        newCapacity *= stack->growthPolicy.growFactor;
+    }
+
+    return _stackSetCapacity(stack, newCapacity);
+}
+
+/**
+ * @brief @see _stackResize that does not race with the auditor.
+*/
+template <typename T>
+static ErrorCode _stackSetCapacity(Stack<T>* stack, size_t newCapacity)
+{
+    if (!stack->audited)
+        return _stackResize(stack, newCapacity);
+
+    pthread_mutex_lock(&_AUDIT_MUTEX);
+    ErrorCode error = _stackResize(stack, newCapacity);
+    pthread_mutex_unlock(&_AUDIT_MUTEX);
+
+    return error;
+}
+
+/**
+ * @brief Moves the stack data to a buffer of newCapacity elements.
+ *
+ * Trivial elements on the heap are moved by realloc, the rest are copied or
+ * move constructed into a new buffer. Capacities up to STACK_INLINE_CAPACITY
+ * use the buffer inside the header. Stacks from a @see StackArena reallocate within it.
+ * Big buffers are mapped @see _shouldMapData, they grow by mremap and shrink
+ * by giving their tail pages back to the system.
+ *
+ * @note The auditor must not be checking the stack @see _stackRealloc.
+ *
+ * @param [in] stack - to resize.
+ * @param [in] newCapacity - new capacity.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+static ErrorCode _stackResize(Stack<T>* stack, size_t newCapacity)
+{
+    if (stack->guarded)
+    {
+        newCapacity = _getGuardedCapacity<T>(newCapacity);
+
+        if (newCapacity == stack->capacity)
+            return EVERYTHING_FINE;
+    }
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        if (newCapacity > stack->capacity)
+            RETURN_ERROR(_reallocHashBlocks(stack, stack->capacity, newCapacity));
+        else
+            _reHashSlotRange(stack, newCapacity, stack->capacity, false);
+    }
+    #endif
+
+    char* oldBuffer = (char*)stack->data - _getDataOffset<T>();
+    size_t newDataSize = _getRealDataSize<T>(newCapacity);
+
+    size_t newHighWaterMark = min(stack->highWaterMark, newCapacity);
+
+    #ifdef CANARY_PROTECTION
+        canary_t* oldRightCanaryPtr = _getRightDataCanaryPtr(stack->data, stack->realDataSize);
+        canary_t  oldRightCanary    = *oldRightCanaryPtr;
+
+        *oldRightCanaryPtr = 0;
+    #endif
+
+    bool oldInline = _isDataInline(stack);
+    bool newInline = !stack->guarded && newCapacity <= STACK_INLINE_CAPACITY;
+
+    bool oldMapped = stack->mappedSize != 0;
+    bool newMapped = !newInline && _shouldMapData(stack, newDataSize);
+
+    // A huge pages mapping keeps its address space when it shrinks and only gives back the pages
+    bool inPlace = oldMapped && newMapped && !stack->guarded && newDataSize <= stack->mappedSize;
+
+    // Only trivial elements can be moved by realloc or mremap
+    bool reallocated = !inPlace && STACK_TRIVIAL<T> && !oldInline && !newInline && oldMapped == newMapped;
+
+    size_t newMappedSize = 0;
+    if (newMapped)
+        newMappedSize = inPlace ? stack->mappedSize : _roundToPages(newDataSize);
+
+    char* newBuffer = NULL;
+
+    if (newInline)
+        newBuffer = stack->inlineData;
+    else if (inPlace)
+    {
+        newBuffer = oldBuffer;
+
+        if (newDataSize < stack->realDataSize)
+            _pagesRelease(oldBuffer, newDataSize, stack->realDataSize);
+    }
+    else if (reallocated)
+        newBuffer = (char*)_stackDataRealloc(stack, (void*)oldBuffer, stack->realDataSize, newDataSize);
+    else
+        newBuffer = (char*)_stackDataAlloc(stack, newDataSize, newMapped);
+
+    if (newBuffer == NULL)
+    {
+        _STACK_DUMP_ERROR_DEBUG(stack, ERROR_NO_MEMORY);
+
+        #ifdef CANARY_PROTECTION
+        *oldRightCanaryPtr = oldRightCanary;
+        #endif
+
+        #ifdef HASH_PROTECTION
+        if (_isHashOn(stack) && newCapacity < stack->capacity)
+            _reHashSlotRange(stack, newCapacity, stack->capacity, true);
+        #endif
+
+        return ERROR_NO_MEMORY;
+    }
+
+    T* newData = (T*)(newBuffer + _getDataOffset<T>());
+
+    // A heap realloc that moved the block has copied it, mremap moves pages
+    size_t bytesCopied = reallocated && !oldMapped && newBuffer != oldBuffer ? min(stack->realDataSize, newDataSize) : 0;
+
+    if (!reallocated && newBuffer != oldBuffer)
+    {
+        // Slots above the high-water mark are not copied, so their pages are not committed
+        bytesCopied = STACK_TRIVIAL<T> ? _getDataOffset<T>() + newHighWaterMark * sizeof(T) : stack->size * sizeof(T);
+
+        if constexpr (STACK_TRIVIAL<T>)
+            memcpy(newBuffer, oldBuffer, bytesCopied);
+        else
+        {
+            #ifdef CANARY_PROTECTION
+            *_getLeftDataCanaryPtr(newData) = *_getLeftDataCanaryPtr(stack->data);
+            #endif
+
+            for (size_t i = 0; i < stack->size; i++)
+            {
+                new (&newData[i]) T(std::move(stack->data[i]));
+                stack->data[i].~T();
+            }
+        }
+
+        if (!oldInline)
+            _stackDataFree(stack, oldBuffer, stack->realDataSize);
+    }
+
+    #ifdef CANARY_PROTECTION
+    *_getRightDataCanaryPtr(newData, newDataSize) = oldRightCanary;
+    #endif
+
+    size_t oldCapacity = stack->capacity;
+
+    stack->data = newData;
+    stack->realDataSize = newDataSize;
+    stack->capacity = newCapacity;
+    stack->highWaterMark = newHighWaterMark;
+    stack->mappedSize = newMappedSize;
+    stack->reallocations++;
+
+    if (oldCapacity < newCapacity)
+        _STACK_STATS_ADD(stack, growReallocations, 1);
+    else
+        _STACK_STATS_ADD(stack, shrinkReallocations, 1);
+
+    _STACK_STATS_ADD(stack, bytesCopied, bytesCopied);
+
+    if (oldCapacity < newCapacity)
+        _poisonNewSlots(stack, oldCapacity, newCapacity);
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        if (oldCapacity < newCapacity)
+            _reHashSlotRange(stack, oldCapacity, newCapacity, true);
+        else
+            _reallocHashBlocks(stack, oldCapacity, newCapacity);
+    }
+    #endif
+
+    #ifdef CANARY_PROTECTION
+    if (_isCanaryOn(stack))
+    {
+        ErrorCode canaryError = _STACK_STATS_TIMED(stack, canaryCheckCycles, _checkCanary(stack));
+        _STACK_DUMP_ERROR_DEBUG(stack, canaryError);
+        RETURN_ERROR(canaryError);
+    }
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+/**
+ * @brief Tells if the current operation has to verify the stack.
+ *
+ * @param [in] stack - the stack.
+ *
+ * @return true if the stack must be verified.
+*/
+template <typename T>
+static bool _shouldVerify(const Stack<T>* stack)
+{
+    if (stack->protection == STACK_PROTECTION_PARANOID ||
+        stack->opsSinceVerified + 1 >= STACK_MAX_UNVERIFIED_OPS ||
+        (stack->verifyPeriod && stack->opsSinceVerified + 1 >= stack->verifyPeriod))
+        return true;
+
+    return stack->verifyIntervalNs && _getTimeNs() - stack->lastVerifiedNs >= stack->verifyIntervalNs;
+}
+
+/**
+ * @brief Makes the stack version odd for the time of a write, @see _endWrite.
+ *
+ * Only the owner thread writes, so no atomic read-modify-write is needed.
+*/
+template <typename T>
+static inline void _beginWrite(Stack<T>* stack)
+{
+    __atomic_store_n(&stack->version, stack->version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+template <typename T>
+static inline void _endWrite(Stack<T>* stack)
+{
+    __atomic_store_n(&stack->version, stack->version + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Updates the unverified operations counter, call before rehashing the stack.
+ *
+ * @param [in] stack - the stack.
+ * @param [in] verified - whether the operation verified the stack.
+*/
+template <typename T>
+static void _countOperation(Stack<T>* stack, bool verified)
+{
+    if (!verified)
+    {
+        stack->opsSinceVerified++;
+        return;
+    }
+
+    stack->opsSinceVerified = 0;
+    if (stack->verifyIntervalNs)
+        stack->lastVerifiedNs = _getTimeNs();
+}
+
+/**
+ * @brief Checks a stack that may be written by its owner at the same time.
+ *
+ * The header and every hash block are checked separately, each under the stack version:
+ * a part whose version changed while it was checked is checked again, up to
+ * AUDIT_ATTEMPTS times, and skipped after that. Must be called under @see _AUDIT_MUTEX
+ * so that the buffer is not reallocated meanwhile.
+ *
+ * @param [in] stack - the stack to check.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+static ErrorCode _auditStack(Stack<T>* stack)
+{
+    const size_t AUDIT_ATTEMPTS = 16;
+
+    size_t blocksCount = 0;
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack) && stack->hashBlocks)
+        blocksCount = _getBlocksCount(stack->capacity);
+    #endif
+
+    for (size_t part = 0; part <= blocksCount; part++)
+    {
+        for (size_t attempt = 0; attempt < AUDIT_ATTEMPTS; attempt++)
+        {
+            uint64_t version = __atomic_load_n(&stack->version, __ATOMIC_ACQUIRE);
+            if (version & 1)
+                continue;
+
+            ErrorCode error = part == 0 ? _auditStackHeader(stack) : _auditStackBlock(stack, part - 1);
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&stack->version, __ATOMIC_RELAXED) != version)
+                continue;
+
+            RETURN_ERROR(error);
+            break;
+        }
+    }
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+static ErrorCode _auditStackHeader(Stack<T>* stack)
+{
+    if (stack->capacity < stack->highWaterMark || stack->highWaterMark < stack->size)
+        return ERROR_INDEX_OUT_OF_BOUNDS;
+    if (!stack->data)
+        return ERROR_NO_MEMORY;
+
+    #ifdef CANARY_PROTECTION
+    if (_isCanaryOn(stack))
+        RETURN_ERROR(_checkCanary(stack));
+    #endif
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        RETURN_ERROR(_checkStackHash(stack));
+
+        hash_t hashData = 0;
+
+        for (size_t block = 0; block < _getBlocksCount(stack->capacity); block++)
+            hashData += stack->hashBlocks[block];
+
+        if (stack->hashData != hashData)
+            return ERROR_BAD_HASH;
+    }
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+static ErrorCode _auditStackBlock(Stack<T>* stack, size_t block)
+{
+    #ifdef HASH_PROTECTION
+    if (stack->hashBlocks[block] != _calculateBlockHash(stack, block))
+        return ERROR_BAD_HASH;
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+static ErrorCode _auditStackErased(void* stack)
+{
+    return _auditStack((Stack<T>*)stack);
+}
+
+template <typename T>
+static ErrorCode _stackDumpErased(FILE* where, void* stack, SourceCodePosition* caller, ErrorCode error)
+{
+    return _stackDump(where, (Stack<T>*)stack, caller, error);
+}
+
+/**
+ * @brief Writes a @see _StackDumpRecord, the data below the high-water mark is written with one fwrite.
+*/
+template <typename T>
+static ErrorCode _stackDumpBinary(FILE* where, Stack<T>* stack, SourceCodePosition* caller, ErrorCode error)
+{
+    const char* specifier = StackTraits<T>::Specifier();
+
+    const char* strings[] = {stack->origin.fileName, stack->origin.name, caller->fileName, caller->name, specifier};
+    uint32_t lengths[sizeof(strings) / sizeof(strings[0])] = {};
+
+    size_t stringsSize = 0;
+
+    for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++)
+    {
+        lengths[i] = strings[i] ? (uint32_t)strlen(strings[i]) : 0;
+        stringsSize += lengths[i];
+    }
+
+    _StackDumpRecord record = {};
+
+    record.magic = STACK_DUMP_MAGIC;
+    record.stack = (uint64_t)(uintptr_t)stack;
+    record.error = (uint32_t)error;
+    record.protection = (uint32_t)stack->protection;
+    record.elementSize = (uint32_t)sizeof(T);
+    record.opsSinceVerified = stack->opsSinceVerified;
+
+    #ifdef HASH_PROTECTION
+    if (_isHashOn(stack))
+    {
+        record.flags |= _STACK_DUMP_HASH;
+
+        record.hashData = stack->hashData;
+        record.expectedHashData = _calculateDataHash(stack);
+        record.hashStack = stack->hashStack;
+        record.expectedHashStack = _calculateStackHash(stack);
+        record.blocksCount = stack->hashBlocks ? _getBlocksCount(stack->capacity) : 0;
+        record.blockSize = STACK_HASH_BLOCK_SIZE;
+    }
+    #endif
+
+    #ifdef CANARY_PROTECTION
+    if (_isCanaryOn(stack))
+    {
+        record.flags |= _STACK_DUMP_CANARY;
+
+        record.leftCanary = stack->leftCanary;
+        record.rightCanary = stack->rightCanary;
+        record.leftDataCanary = *_getLeftDataCanaryPtr(stack->data);
+        record.rightDataCanary = *_getRightDataCanaryPtr(stack->data, stack->realDataSize);
+        record.expectedCanary = _CANARY;
+    }
+    #endif
+
+    if (stack->guarded)
+        record.flags |= _STACK_DUMP_GUARDED;
+
+    if (stack->growthPolicy.noShrink)
+        record.flags |= _STACK_DUMP_NOSHRINK;
+
+    record.size = stack->size;
+    record.capacity = stack->capacity;
+    record.highWaterMark = stack->highWaterMark;
+    record.reservedCapacity = stack->reservedCapacity;
+    record.reallocations = stack->reallocations;
+    record.growFactor = stack->growthPolicy.growFactor;
+    record.shrinkDivisor = stack->growthPolicy.shrinkDivisor;
+    record.minCapacity = stack->growthPolicy.minCapacity;
+
+    record.data = (uint64_t)(uintptr_t)stack->data;
+    record.mappedSize = stack->mappedSize;
+
+    record.originLine = stack->origin.line;
+    record.callerLine = caller->line;
+    record.originFileLength = lengths[0];
+    record.originNameLength = lengths[1];
+    record.callerFileLength = lengths[2];
+    record.callerNameLength = lengths[3];
+    record.specifierLength = lengths[4];
+
+    record.recordSize = sizeof(record) + stringsSize + record.blocksCount * 2 * sizeof(uint32_t) +
+                        (1 + stack->highWaterMark) * sizeof(T);
+
+    fwrite(&record, sizeof(record), 1, where);
+
+    for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++)
+        if (lengths[i])
+            fwrite(strings[i], 1, lengths[i], where);
+
+    #ifdef HASH_PROTECTION
+    for (size_t block = 0; block < record.blocksCount; block++)
+    {
+        uint32_t blockHashes[2] = {stack->hashBlocks[block], _calculateBlockHash(stack, block)};
+
+        fwrite(blockHashes, sizeof(blockHashes), 1, where);
+    }
+    #endif
+
+    T poison = _getPoison<T>();
+
+    fwrite(&poison, sizeof(T), 1, where);
+    fwrite(stack->data, sizeof(T), stack->highWaterMark, where);
+
+    return EVERYTHING_FINE;
+}
+
+/**
+ * @brief Dumps a guarded stack whose guard page was hit, called from the SIGSEGV handler.
+ *
+ * The dump goes to @see _logCrashStream rather than LOG_FILE, whose lock the faulting
+ * code may hold, and reaches the file by write only.
+*/
+template <typename T>
+static void _stackGuardFault(void* stack)
+{
+    SourceCodePosition caller = {__FILE__, __LINE__, __func__};
+
+    FILE* crashStream = _logCrashStream();
+
+    if (crashStream)
+    {
+        _stackDump(crashStream, (Stack<T>*)stack, &caller, ERROR_DEAD_CANARY);
+        _logCrashFlush();
+    }
+}
+
+#ifdef CANARY_PROTECTION
+template <typename T>
+static ErrorCode _checkCanary(const Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    if (stack->leftCanary != _CANARY || stack->rightCanary != _CANARY)
+        return ERROR_DEAD_CANARY;
+
+    // Guarded stacks too, an overrun by a slot or two lands in the data canaries before the guard pages
+    if (*_getLeftDataCanaryPtr(stack->data) != _CANARY ||
+        *_getRightDataCanaryPtr(stack->data, stack->realDataSize) != _CANARY)
+    {
+        return ERROR_DEAD_CANARY;
+    }
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+static canary_t* _getLeftDataCanaryPtr(const T* data)
+{
+    return (canary_t*)((const char*)data - sizeof(canary_t));
+}
+
+template <typename T>
+static canary_t* _getRightDataCanaryPtr(const T* data, size_t realDataSize)
+{
+    return (canary_t*)((const char*)data - _getDataOffset<T>() + realDataSize - sizeof(canary_t));
+}
+#endif
+
+#ifdef HASH_PROTECTION
+template <typename T>
+static ErrorCode _reHashify(Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    hash_t hashData = 0;
+
+    if (stack->hashBlocks)
+        for (size_t block = 0; block < _getBlocksCount(stack->capacity); block++)
+        {
+            stack->hashBlocks[block] = _calculateBlockHash(stack, block);
+            hashData += stack->hashBlocks[block];
+        }
+
+    stack->hashData = hashData;
+    stack->hashStack = _calculateStackHash(stack);
+
+    return EVERYTHING_FINE;
+}
+
+/**
+ * @brief Resizes the block hashes array from oldCapacity to newCapacity elements.
+ *
+ * New blocks get zero hash, removed blocks must already be subtracted.
+ * A single block is kept inside the header. If shrinking fails, the old bigger
+ * array is kept, hashBlocksAllocated always tells the size it was allocated with.
+*/
+template <typename T>
+static ErrorCode _reallocHashBlocks(Stack<T>* stack, size_t oldCapacity, size_t newCapacity)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    size_t oldBlocksCount = stack->hashBlocks ? _getBlocksCount(oldCapacity) : 0;
+    size_t newBlocksCount = _getBlocksCount(newCapacity);
+
+    if (oldBlocksCount == newBlocksCount)
+        return EVERYTHING_FINE;
+
+    hash_t* inlineHashBlock = &stack->inlineHashBlock;
+    hash_t* oldHashBlocks = stack->hashBlocks;
+    hash_t* newHashBlocks = inlineHashBlock;
+
+    if (newBlocksCount > 1)
+    {
+        if (oldHashBlocks == inlineHashBlock)
+        {
+            newHashBlocks = (hash_t*)_stackMemAlloc(stack->arena, newBlocksCount * sizeof(hash_t));
+
+            if (newHashBlocks)
+                newHashBlocks[0] = *inlineHashBlock;
+        }
+        else
+            newHashBlocks = (hash_t*)_stackMemRealloc(stack->arena, oldHashBlocks,
+                                                      stack->hashBlocksAllocated * sizeof(hash_t),
+                                                      newBlocksCount * sizeof(hash_t));
+
+        // A failed shrink keeps the old array, which still has room for every block
+        if (!newHashBlocks)
+            return newBlocksCount < oldBlocksCount ? EVERYTHING_FINE : ERROR_NO_MEMORY;
+    }
+    else if (oldHashBlocks && oldHashBlocks != inlineHashBlock)
+    {
+        *inlineHashBlock = oldHashBlocks[0];
+        _stackMemFree(stack->arena, oldHashBlocks, stack->hashBlocksAllocated * sizeof(hash_t));
+    }
+
+    for (size_t block = oldBlocksCount; block < newBlocksCount; block++)
+        newHashBlocks[block] = 0;
+
+    stack->hashBlocks = newHashBlocks;
+    stack->hashBlocksAllocated = newHashBlocks == inlineHashBlock ? 1 : newBlocksCount;
+
+    return EVERYTHING_FINE;
+}
+
+static inline size_t _getBlocksCount(size_t capacity)
+{
+    return (capacity + STACK_HASH_BLOCK_SIZE - 1) / STACK_HASH_BLOCK_SIZE;
+}
+
+/**
+ * @brief Updates the data hash after data[index] changed from oldValue to newValue.
+ *
+ * @note Does not update the stack hash, call @see _calculateStackHash afterwards.
+*/
+template <typename T>
+static void _reHashSlot(Stack<T>* stack, size_t index, const T& oldValue, const T& newValue)
+{
+    hash_t delta = _calculateSlotHash(index, newValue) - _calculateSlotHash(index, oldValue);
+
+    stack->hashBlocks[index / STACK_HASH_BLOCK_SIZE] += delta;
+    stack->hashData += delta;
+}
+
+/**
+ * @brief Adds or removes poisoned slots [from, to) to or from the data hash.
+*/
+template <typename T>
+static void _reHashSlotRange(Stack<T>* stack, size_t from, size_t to, bool add)
+{
+    T poison = _getPoison<T>();
+
+    for (size_t i = from; i < to; i++)
+    {
+        hash_t delta = _calculateSlotHash(i, poison);
+
+        if (!add)
+            delta = -delta;
+
+        stack->hashBlocks[i / STACK_HASH_BLOCK_SIZE] += delta;
+        stack->hashData += delta;
+    }
+}
+
+/**
+ * @brief Hash of a single slot keyed by its position.
+ *
+ * Block hash is the sum of its slot hashes and data hash is the sum of
+ * the block hashes, so changing one slot only needs its old and new hashes.
+*/
+template <typename T>
+static hash_t _calculateSlotHash(size_t index, const T& value)
+{
+    return CalculateHash((const void*)&value, sizeof(T), HASH_SEED ^ (hash_t)(index * 0x9E3779B9));
+}
+
+template <typename T>
+static hash_t _calculateDataHash(const Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    hash_t hashData = 0;
+
+    for (size_t block = 0; block < _getBlocksCount(stack->capacity); block++)
+        hashData += _calculateBlockHash(stack, block);
+
+    return hashData;
+}
+
+template <typename T>
+static hash_t _calculateBlockHash(const Stack<T>* stack, size_t block)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    size_t firstSlot = block * STACK_HASH_BLOCK_SIZE;
+    size_t lastSlot  = min(firstSlot + STACK_HASH_BLOCK_SIZE, stack->capacity);
+
+    // Slots above the high-water mark are hashed as poison without reading them
+    size_t lastWritten = max(firstSlot, min(lastSlot, stack->highWaterMark));
+
+    hash_t blockHash = 0;
+
+    for (size_t i = firstSlot; i < lastWritten; i++)
+        blockHash += _calculateSlotHash(i, stack->data[i]);
+
+    T poison = _getPoison<T>();
+
+    for (size_t i = lastWritten; i < lastSlot; i++)
+        blockHash += _calculateSlotHash(i, poison);
+
+    return blockHash;
+}
+
+template <typename T>
+static hash_t _calculateStackHash(Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    const size_t headerSize = offsetof(Stack<T>, inlineData);
+
+    Stack<T> stackCopy = {};
+    memcpy((void*)&stackCopy, (const void*)stack, headerSize);
+
+    stackCopy.hashStack = 0;
+    stackCopy.version = 0;
+
+    return CalculateHash((const void*)&stackCopy, headerSize, HASH_SEED);
+}
+
+template <typename T>
+static ErrorCode _checkStackHash(Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    if (stack->hashStack != _calculateStackHash(stack))
+        return ERROR_BAD_HASH;
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+static ErrorCode _checkHash(Stack<T>* stack)
+{
+    MyAssertSoft(stack, ERROR_NULLPTR);
+
+    if (stack->hashStack != _calculateStackHash(stack))
+        return ERROR_BAD_HASH;
+
+    hash_t hashData = 0;
+
+    for (size_t block = 0; block < _getBlocksCount(stack->capacity); block++)
+    {
+        if (stack->hashBlocks[block] != _calculateBlockHash(stack, block))
+            return ERROR_BAD_HASH;
+
+        hashData += stack->hashBlocks[block];
+    }
+
+    if (stack->hashData != hashData)
+        return ERROR_BAD_HASH;
+
+    return EVERYTHING_FINE;
+}
+#endif
+
+#endif
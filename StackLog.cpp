@@ -0,0 +1,344 @@
+#include <time.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "Stack.hpp"
+
+/**
+ * @brief Single producer ring, the producer is serialized by the stream lock.
+ *
+ * head and tail only grow, the buffer holds bytes [tail, head).
+ * flushing is held by whoever writes the ring out, the flusher or a crash.
+*/
+struct _Log
+{
+    char buffer[STACK_LOG_BUFFER_SIZE];
+
+    size_t head;
+    size_t tail;
+    size_t dropped;
+
+    StackLogOverflow overflow;
+    bool flushing;
+    bool running;
+
+    int fd;
+    FILE* stream;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeUp;
+};
+
+static_assert((STACK_LOG_BUFFER_SIZE & (STACK_LOG_BUFFER_SIZE - 1)) == 0, "Log buffer size must be a power of two");
+
+static _Log _LOG = { .overflow = DEFAULT_LOG_OVERFLOW, .fd = -1,
+                     .mutex = PTHREAD_MUTEX_INITIALIZER, .wakeUp = PTHREAD_COND_INITIALIZER };
+
+static pthread_once_t _LOG_START_ONCE = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Bytes written to the crash stream, @see _logCrashStream.
+*/
+struct _CrashLog
+{
+    char buffer[STACK_LOG_CRASH_BUFFER_SIZE];
+    size_t size;
+
+    FILE* stream;
+};
+
+static _CrashLog _CRASH_LOG = {};
+
+static struct sigaction _PREVIOUS_ABORT_ACTION = {};
+
+static ssize_t _logWrite(void* cookie, const char* data, size_t size);
+
+static int _logClose(void* cookie);
+
+static void _logStart();
+
+static void _logStop();
+
+static void* _logThread(void*);
+
+static void _logDrain();
+
+static void _logAbortHandler(int signal);
+
+static void _logDrainFromSignal();
+
+static ssize_t _crashWrite(void* cookie, const char* data, size_t size);
+
+static void _writeAll(int fd, const char* data, size_t size);
+
+FILE* _logOpen(int fd)
+{
+    cookie_io_functions_t functions = { .read = NULL, .write = _logWrite, .seek = NULL, .close = _logClose };
+
+    FILE* stream = fopencookie(&_LOG, "w", functions);
+
+    if (!stream)
+        return NULL;
+
+    _LOG.fd = fd;
+    _LOG.stream = stream;
+
+    // Created here, a signal handler must not allocate it
+    cookie_io_functions_t crashFunctions = { .read = NULL, .write = _crashWrite, .seek = NULL, .close = NULL };
+
+    _CRASH_LOG.stream = fopencookie(&_CRASH_LOG, "w", crashFunctions);
+
+    if (_CRASH_LOG.stream)
+        setvbuf(_CRASH_LOG.stream, NULL, _IONBF, 0);
+
+    return stream;
+}
+
+void StackLogSetOverflow(StackLogOverflow policy)
+{
+    __atomic_store_n(&_LOG.overflow, policy, __ATOMIC_RELAXED);
+}
+
+void StackLogFlush()
+{
+    if (!_LOG.stream)
+        return;
+
+    fflush(_LOG.stream);
+
+    while (__atomic_exchange_n(&_LOG.flushing, true, __ATOMIC_ACQUIRE))
+        sched_yield();
+
+    _logDrain();
+
+    __atomic_store_n(&_LOG.flushing, false, __ATOMIC_RELEASE);
+}
+
+size_t StackLogDroppedBytes()
+{
+    return __atomic_load_n(&_LOG.dropped, __ATOMIC_RELAXED);
+}
+
+FILE* _logCrashStream()
+{
+    return _CRASH_LOG.stream;
+}
+
+void _logCrashFlush()
+{
+    if (_LOG.fd < 0)
+        return;
+
+    _logDrainFromSignal();
+
+    _writeAll(_LOG.fd, _CRASH_LOG.buffer, _CRASH_LOG.size);
+    _CRASH_LOG.size = 0;
+}
+
+static ssize_t _logWrite(void*, const char* data, size_t size)
+{
+    pthread_once(&_LOG_START_ONCE, _logStart);
+
+    if (!__atomic_load_n(&_LOG.running, __ATOMIC_ACQUIRE))
+    {
+        _writeAll(_LOG.fd, data, size);
+        return (ssize_t)size;
+    }
+
+    size_t written = 0;
+
+    while (written < size)
+    {
+        size_t head = _LOG.head;
+        size_t space = STACK_LOG_BUFFER_SIZE - (head - __atomic_load_n(&_LOG.tail, __ATOMIC_ACQUIRE));
+
+        if (space == 0)
+        {
+            if (__atomic_load_n(&_LOG.overflow, __ATOMIC_RELAXED) == STACK_LOG_DROP)
+            {
+                __atomic_fetch_add(&_LOG.dropped, size - written, __ATOMIC_RELAXED);
+                break;
+            }
+
+            pthread_cond_signal(&_LOG.wakeUp);
+            sched_yield();
+
+            continue;
+        }
+
+        size_t chunk = min(space, size - written);
+        size_t offset = head & (STACK_LOG_BUFFER_SIZE - 1);
+        size_t first = min(chunk, STACK_LOG_BUFFER_SIZE - offset);
+
+        memcpy(_LOG.buffer + offset, data + written, first);
+        memcpy(_LOG.buffer, data + written + first, chunk - first);
+
+        __atomic_store_n(&_LOG.head, head + chunk, __ATOMIC_RELEASE);
+
+        written += chunk;
+    }
+
+    return (ssize_t)size;
+}
+
+static int _logClose(void*)
+{
+    _logStop();
+
+    return close(_LOG.fd);
+}
+
+static void _logStart()
+{
+    __atomic_store_n(&_LOG.running, true, __ATOMIC_RELEASE);
+
+    if (pthread_create(&_LOG.thread, NULL, _logThread, NULL) != 0)
+    {
+        __atomic_store_n(&_LOG.running, false, __ATOMIC_RELEASE);
+        return;
+    }
+
+    struct sigaction action = {};
+
+    action.sa_handler = _logAbortHandler;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGABRT, &action, &_PREVIOUS_ABORT_ACTION);
+
+    atexit(_logStop);
+}
+
+/**
+ * @brief Stops the flusher and writes the ring out, later writes go to the file directly.
+*/
+static void _logStop()
+{
+    pthread_mutex_lock(&_LOG.mutex);
+
+    bool running = _LOG.running;
+    __atomic_store_n(&_LOG.running, false, __ATOMIC_RELEASE);
+
+    pthread_cond_signal(&_LOG.wakeUp);
+    pthread_mutex_unlock(&_LOG.mutex);
+
+    if (running)
+        pthread_join(_LOG.thread, NULL);
+
+    StackLogFlush();
+}
+
+static void* _logThread(void*)
+{
+    pthread_mutex_lock(&_LOG.mutex);
+
+    while (true)
+    {
+        bool running = _LOG.running;
+
+        pthread_mutex_unlock(&_LOG.mutex);
+
+        while (__atomic_exchange_n(&_LOG.flushing, true, __ATOMIC_ACQUIRE))
+            sched_yield();
+
+        _logDrain();
+
+        __atomic_store_n(&_LOG.flushing, false, __ATOMIC_RELEASE);
+
+        pthread_mutex_lock(&_LOG.mutex);
+
+        if (!running)
+            break;
+
+        timespec deadline = {};
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        uint64_t nsec = (uint64_t)deadline.tv_nsec + STACK_LOG_FLUSH_PERIOD_NS;
+        deadline.tv_sec  += (time_t)(nsec / 1000000000);
+        deadline.tv_nsec  = (long)(nsec % 1000000000);
+
+        if (_LOG.running)
+            pthread_cond_timedwait(&_LOG.wakeUp, &_LOG.mutex, &deadline);
+    }
+
+    pthread_mutex_unlock(&_LOG.mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief Writes bytes [tail, head) to the file, the caller must hold flushing.
+ *
+ * Only uses write, so it can be called from a signal handler.
+*/
+static void _logDrain()
+{
+    size_t tail = _LOG.tail;
+    size_t head = __atomic_load_n(&_LOG.head, __ATOMIC_ACQUIRE);
+
+    if (tail == head)
+        return;
+
+    size_t offset = tail & (STACK_LOG_BUFFER_SIZE - 1);
+    size_t first = min(head - tail, STACK_LOG_BUFFER_SIZE - offset);
+
+    _writeAll(_LOG.fd, _LOG.buffer + offset, first);
+    _writeAll(_LOG.fd, _LOG.buffer, head - tail - first);
+
+    __atomic_store_n(&_LOG.tail, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Writes the ring out and lets the previous action handle the signal.
+*/
+static void _logAbortHandler(int signal)
+{
+    _logDrainFromSignal();
+
+    sigaction(SIGABRT, &_PREVIOUS_ABORT_ACTION, NULL);
+
+    // Blocked until the handler returns, then the previous action gets it
+    raise(signal);
+}
+
+/**
+ * @brief @see _logDrain for a signal handler, the process is about to die.
+ *
+ * Waits for a running flush for a short while, then writes anyway,
+ * so a flusher stopped by the crash does not lose the log.
+*/
+static void _logDrainFromSignal()
+{
+    const size_t maxYields = 1 << 16;
+
+    for (size_t i = 0; i < maxYields && __atomic_exchange_n(&_LOG.flushing, true, __ATOMIC_ACQUIRE); i++)
+        sched_yield();
+
+    _logDrain();
+}
+
+static ssize_t _crashWrite(void*, const char* data, size_t size)
+{
+    size_t chunk = min(size, STACK_LOG_CRASH_BUFFER_SIZE - _CRASH_LOG.size);
+
+    memcpy(_CRASH_LOG.buffer + _CRASH_LOG.size, data, chunk);
+    _CRASH_LOG.size += chunk;
+
+    return (ssize_t)size;
+}
+
+static void _writeAll(int fd, const char* data, size_t size)
+{
+    while (size)
+    {
+        ssize_t written = write(fd, data, size);
+
+        if (written <= 0)
+            return;
+
+        data += written;
+        size -= (size_t)written;
+    }
+}
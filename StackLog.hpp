@@ -0,0 +1,68 @@
+//! @file
+
+#ifndef STACK_LOG_HPP
+#define STACK_LOG_HPP
+
+#include <stdio.h>
+#include <stddef.h>
+#include "Utils.hpp"
+
+/** @enum StackLogOverflow
+ * @brief What a write to LOG_FILE does when the log buffer is full, @see StackLogSetOverflow.
+ *
+ * @var STACK_LOG_BLOCK - waits for the flusher thread, nothing is lost.
+ * @var STACK_LOG_DROP - drops the part that does not fit and counts it, @see StackLogDroppedBytes.
+ */
+enum StackLogOverflow
+{
+    STACK_LOG_BLOCK,
+    STACK_LOG_DROP,
+};
+
+/**
+ * @brief Returns a stream that appends to a ring buffer written to fd by a background thread.
+ *
+ * Writes to the stream are stdio buffered and reach the ring on fflush, which costs
+ * a memcpy and no syscalls. The flusher thread starts on the first write. The ring
+ * is written out on exit and on SIGABRT, later writes go to fd directly.
+ *
+ * @param [in] fd - the log file, owned by the stream.
+ *
+ * @return the stream, NULL if it can't be created.
+*/
+FILE* _logOpen(int fd);
+
+/**
+ * @brief Sets the overflow policy of LOG_FILE, @see StackLogOverflow.
+*/
+void StackLogSetOverflow(StackLogOverflow policy);
+
+/**
+ * @brief Writes everything logged so far to the log file and waits for it.
+*/
+void StackLogFlush();
+
+/**
+ * @brief Returns how many bytes @see STACK_LOG_DROP has dropped.
+*/
+size_t StackLogDroppedBytes();
+
+/**
+ * @brief Returns a stream into a preallocated buffer for dumps made in a signal handler.
+ *
+ * Unlike LOG_FILE, it is unbuffered and not shared with the interrupted code, so writing
+ * to it neither waits on a lock that code may hold nor allocates. @see _logCrashFlush
+ * writes it out, whatever does not fit in @see STACK_LOG_CRASH_BUFFER_SIZE is dropped.
+ *
+ * @return the stream, NULL if LOG_FILE was not opened.
+*/
+FILE* _logCrashStream();
+
+/**
+ * @brief Writes the ring, then the crash stream out with write only, for signal handlers.
+ *
+ * Whatever is still in the stdio buffer of LOG_FILE is not written.
+*/
+void _logCrashFlush();
+
+#endif
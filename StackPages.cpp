@@ -0,0 +1,364 @@
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "StackPages.hpp"
+
+/**
+ * @brief Mapped block, looked up by the SIGSEGV handler.
+ *
+ * Entries are never freed, an unmapped block leaves its entry for reuse,
+ * so the handler can walk the list without taking the mutex.
+*/
+struct _PagesEntry
+{
+    char* block;
+    size_t size;
+
+    void* owner;
+    _PagesFaultFunction onFault;
+
+    _PagesEntry* next;
+};
+
+static pthread_mutex_t _PAGES_MUTEX = PTHREAD_MUTEX_INITIALIZER;
+
+static _PagesEntry* _PAGES_ENTRIES = NULL;
+
+static pthread_once_t _PAGES_HANDLER_ONCE = PTHREAD_ONCE_INIT;
+
+static struct sigaction _PREVIOUS_SEGV_ACTION = {};
+
+/**
+ * @brief Huge pages are only used for aligned ranges, 2 MB is the size on x86-64.
+*/
+static const size_t _HUGE_PAGE_SIZE = 2 << 20;
+
+static char* _mapAligned(size_t size, size_t alignment, int protection);
+
+static void _installSignalHandler();
+
+static void _pagesSignalHandler(int signal, siginfo_t* info, void* context);
+
+static void _writeFaultMessage(bool overflow, const void* address);
+
+static _PagesEntry* _findEntry(const char* block);
+
+static ErrorCode _addEntry(char* block, size_t size, void* owner, _PagesFaultFunction onFault);
+
+size_t _getPageSize()
+{
+    static size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+    return pageSize;
+}
+
+void* _pagesAlloc(size_t size, void* owner, _PagesFaultFunction onFault)
+{
+    pthread_once(&_PAGES_HANDLER_ONCE, _installSignalHandler);
+
+    size_t pageSize = _getPageSize();
+    size = _roundToPages(size);
+
+    char* mapping = (char*)mmap(NULL, size + 2 * pageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    char* block = mapping + pageSize;
+
+    if (mprotect(block, size, PROT_READ | PROT_WRITE) != 0 ||
+        _addEntry(block, size, owner, onFault))
+    {
+        munmap(mapping, size + 2 * pageSize);
+        return NULL;
+    }
+
+    return block;
+}
+
+void* _pagesRealloc(void* block, size_t oldSize, size_t newSize)
+{
+    if (!block)
+        return NULL;
+
+    size_t pageSize = _getPageSize();
+
+    oldSize = _roundToPages(oldSize);
+    newSize = _roundToPages(newSize);
+
+    if (oldSize == newSize)
+        return block;
+
+    // Reserve the new guards and data at once, then move the data pages in between
+    char* mapping = (char*)mmap(NULL, newSize + 2 * pageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    char* oldBlock = (char*)block;
+    char* newBlock = (char*)mremap(oldBlock, oldSize, newSize, MREMAP_MAYMOVE | MREMAP_FIXED, mapping + pageSize);
+
+    if (newBlock == MAP_FAILED)
+    {
+        munmap(mapping, newSize + 2 * pageSize);
+        return NULL;
+    }
+
+    munmap(oldBlock - pageSize, pageSize);
+    munmap(oldBlock + oldSize, pageSize);
+
+    pthread_mutex_lock(&_PAGES_MUTEX);
+
+    _PagesEntry* entry = _findEntry(oldBlock);
+
+    if (entry)
+    {
+        __atomic_store_n(&entry->size, newSize, __ATOMIC_RELAXED);
+        __atomic_store_n(&entry->block, newBlock, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&_PAGES_MUTEX);
+
+    return newBlock;
+}
+
+void _pagesFree(void* block, size_t size)
+{
+    if (!block)
+        return;
+
+    size_t pageSize = _getPageSize();
+    size = _roundToPages(size);
+
+    pthread_mutex_lock(&_PAGES_MUTEX);
+
+    _PagesEntry* entry = _findEntry((char*)block);
+
+    if (entry)
+        __atomic_store_n(&entry->block, NULL, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&_PAGES_MUTEX);
+
+    munmap((char*)block - pageSize, size + 2 * pageSize);
+}
+
+void* _hugePagesAlloc(size_t size)
+{
+    size = _roundToPages(size);
+
+    char* block = _mapAligned(size, _HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE);
+
+    if (!block)
+        return NULL;
+
+    madvise(block, size, MADV_HUGEPAGE);
+
+    return block;
+}
+
+void* _hugePagesRealloc(void* block, size_t oldSize, size_t newSize)
+{
+    if (!block)
+        return NULL;
+
+    oldSize = _roundToPages(oldSize);
+    newSize = _roundToPages(newSize);
+
+    if (newSize <= oldSize)
+        return block;
+
+    if (mremap(block, oldSize, newSize, 0) != MAP_FAILED)
+        return block;
+
+    // Can't grow in place, move the pages to a new huge page aligned range
+    char* target = _mapAligned(newSize, _HUGE_PAGE_SIZE, PROT_NONE);
+
+    if (!target)
+        return NULL;
+
+    char* newBlock = (char*)mremap(block, oldSize, newSize, MREMAP_MAYMOVE | MREMAP_FIXED, target);
+
+    if (newBlock == MAP_FAILED)
+    {
+        munmap(target, newSize);
+        return NULL;
+    }
+
+    return newBlock;
+}
+
+void _hugePagesFree(void* block, size_t size)
+{
+    if (block)
+        munmap(block, _roundToPages(size));
+}
+
+void _pagesRelease(void* block, size_t from, size_t to)
+{
+    size_t pageSize = _getPageSize();
+
+    from = (from + pageSize - 1) / pageSize * pageSize;
+    to   = to / pageSize * pageSize;
+
+    if (from < to)
+        madvise((char*)block + from, to - from, MADV_DONTNEED);
+}
+
+/**
+ * @brief Maps size bytes at an address aligned to alignment by trimming a bigger mapping.
+*/
+static char* _mapAligned(size_t size, size_t alignment, int protection)
+{
+    size_t mappingSize = size + alignment;
+
+    char* mapping = (char*)mmap(NULL, mappingSize, protection, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    char* block = (char*)(((uintptr_t)mapping + alignment - 1) / alignment * alignment);
+    char* mappingEnd = mapping + mappingSize;
+
+    if (block != mapping)
+        munmap(mapping, (size_t)(block - mapping));
+
+    if (block + size != mappingEnd)
+        munmap(block + size, (size_t)(mappingEnd - block - size));
+
+    return block;
+}
+
+static void _installSignalHandler()
+{
+    struct sigaction action = {};
+
+    action.sa_sigaction = _pagesSignalHandler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGSEGV, &action, &_PREVIOUS_SEGV_ACTION);
+}
+
+/**
+ * @brief Prints the guard page hit to stderr like the other errors, but with write only.
+*/
+static void _writeFaultMessage(bool overflow, const void* address)
+{
+    char message[128] = "\033[0;31mERROR!!! STACK BUFFER ";
+    size_t length = strlen(message);
+
+    const char* kind = overflow ? "OVERFLOW AT 0x" : "UNDERFLOW AT 0x";
+    memcpy(message + length, kind, strlen(kind));
+    length += strlen(kind);
+
+    uintptr_t value = (uintptr_t)address;
+
+    for (int shift = (int)sizeof(value) * 8 - 4; shift >= 0; shift -= 4)
+        message[length++] = "0123456789abcdef"[(value >> shift) & 0xf];
+
+    const char* end = "!!!!\n\033[0;37m";
+    memcpy(message + length, end, strlen(end));
+    length += strlen(end);
+
+    ssize_t written = write(STDERR_FILENO, message, length);
+    (void)written;
+}
+
+/**
+ * @brief Reports a hit guard page and lets the fault happen again with the default action.
+ *
+ * Other faults are passed to the previous action, the handler stays installed for them.
+*/
+static void _pagesSignalHandler(int signal, siginfo_t* info, void* context)
+{
+    const char* address = (const char*)info->si_addr;
+    size_t pageSize = _getPageSize();
+
+    for (_PagesEntry* entry = __atomic_load_n(&_PAGES_ENTRIES, __ATOMIC_ACQUIRE); entry; entry = entry->next)
+    {
+        const char* block = __atomic_load_n(&entry->block, __ATOMIC_ACQUIRE);
+        size_t size = __atomic_load_n(&entry->size, __ATOMIC_RELAXED);
+
+        if (!block)
+            continue;
+
+        bool underflow = block - pageSize <= address && address < block;
+        bool overflow  = block + size <= address && address < block + size + pageSize;
+
+        if (!underflow && !overflow)
+            continue;
+
+        _writeFaultMessage(overflow, info->si_addr);
+
+        if (entry->onFault)
+            entry->onFault(entry->owner);
+
+        struct sigaction defaultAction = {};
+        defaultAction.sa_handler = SIG_DFL;
+        sigaction(SIGSEGV, &defaultAction, NULL);
+
+        return;
+    }
+
+    if (_PREVIOUS_SEGV_ACTION.sa_flags & SA_SIGINFO)
+    {
+        _PREVIOUS_SEGV_ACTION.sa_sigaction(signal, info, context);
+        return;
+    }
+
+    if (_PREVIOUS_SEGV_ACTION.sa_handler != SIG_DFL && _PREVIOUS_SEGV_ACTION.sa_handler != SIG_IGN)
+    {
+        _PREVIOUS_SEGV_ACTION.sa_handler(signal);
+        return;
+    }
+
+    // An ignored fault would happen again forever, so both die with the default action
+    struct sigaction defaultAction = {};
+    defaultAction.sa_handler = SIG_DFL;
+    sigaction(SIGSEGV, &defaultAction, NULL);
+}
+
+/**
+ * @brief Must be called under @see _PAGES_MUTEX.
+*/
+static _PagesEntry* _findEntry(const char* block)
+{
+    for (_PagesEntry* entry = _PAGES_ENTRIES; entry; entry = entry->next)
+        if (entry->block == block)
+            return entry;
+
+    return NULL;
+}
+
+static ErrorCode _addEntry(char* block, size_t size, void* owner, _PagesFaultFunction onFault)
+{
+    pthread_mutex_lock(&_PAGES_MUTEX);
+
+    _PagesEntry* entry = _findEntry(NULL);
+
+    if (!entry)
+    {
+        entry = (_PagesEntry*)calloc(1, sizeof(_PagesEntry));
+
+        if (!entry)
+        {
+            pthread_mutex_unlock(&_PAGES_MUTEX);
+            return ERROR_NO_MEMORY;
+        }
+
+        entry->next = _PAGES_ENTRIES;
+        __atomic_store_n(&_PAGES_ENTRIES, entry, __ATOMIC_RELEASE);
+    }
+
+    entry->size = size;
+    entry->owner = owner;
+    entry->onFault = onFault;
+    __atomic_store_n(&entry->block, block, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&_PAGES_MUTEX);
+
+    return EVERYTHING_FINE;
+}
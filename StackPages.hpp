@@ -0,0 +1,87 @@
+//! @file
+
+#ifndef STACK_PAGES_HPP
+#define STACK_PAGES_HPP
+
+#include <stddef.h>
+#include "Utils.hpp"
+
+/**
+ * @brief Called from the SIGSEGV handler when the owner's guard page is hit.
+*/
+typedef void (*_PagesFaultFunction)(void* owner);
+
+/**
+ * @brief Returns the system page size.
+*/
+size_t _getPageSize();
+
+/**
+ * @brief Rounds size up to whole pages, one page at least.
+*/
+static inline size_t _roundToPages(size_t size)
+{
+    size_t pageSize = _getPageSize();
+
+    if (size == 0)
+        size = 1;
+
+    return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+/**
+ * @brief Maps a page aligned block of at least size bytes between two PROT_NONE guard pages.
+ *
+ * Any access to a guard page raises SIGSEGV. The first such block installs
+ * a handler that calls onFault(owner) for the block whose guard was hit and
+ * then lets the signal kill the process, faults elsewhere go to the previous handler.
+ *
+ * @param [in] size - block size in bytes.
+ * @param [in] owner - passed to onFault.
+ * @param [in] onFault - called on a guard page fault, may be NULL.
+ *
+ * @return the block, NULL if mapping failed.
+*/
+void* _pagesAlloc(size_t size, void* owner, _PagesFaultFunction onFault);
+
+/**
+ * @brief Resizes a block from @see _pagesAlloc with mremap, its pages are moved, not copied.
+ *
+ * @return the new block, NULL if remapping failed, then the old block is intact.
+*/
+void* _pagesRealloc(void* block, size_t oldSize, size_t newSize);
+
+/**
+ * @brief Unmaps a block from @see _pagesAlloc with its guard pages.
+*/
+void _pagesFree(void* block, size_t size);
+
+/**
+ * @brief Maps a block of at least size bytes aligned to a huge page and advised for transparent huge pages.
+ *
+ * @return the block, NULL if mapping failed.
+*/
+void* _hugePagesAlloc(size_t size);
+
+/**
+ * @brief Grows a block from @see _hugePagesAlloc with mremap, in place if the address space allows.
+ *
+ * A smaller size leaves the block as is, shrinking buffers keep their mapping and
+ * release the tail pages with @see _pagesRelease instead.
+ * @return the new block, NULL if remapping failed, then the old block is intact.
+*/
+void* _hugePagesRealloc(void* block, size_t oldSize, size_t newSize);
+
+/**
+ * @brief Unmaps a block from @see _hugePagesAlloc.
+*/
+void _hugePagesFree(void* block, size_t size);
+
+/**
+ * @brief Gives the whole pages of block bytes [from, to) back to the system with MADV_DONTNEED.
+ *
+ * The range stays mapped and reads as zeros afterwards.
+*/
+void _pagesRelease(void* block, size_t from, size_t to);
+
+#endif
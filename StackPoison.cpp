@@ -0,0 +1,146 @@
+#include <string.h>
+#include <stdint.h>
+#include <immintrin.h>
+#include "StackPoison.hpp"
+
+static const size_t _VECTOR_SIZE = sizeof(__m256i);
+
+static bool _canUseAvx2(size_t patternSize);
+
+static void _fillPatternAvx2(void* data, const void* pattern, size_t patternSize, size_t count);
+
+static size_t _findPatternMismatchAvx2(const void* data, const void* pattern, size_t patternSize, size_t count);
+
+static size_t _findPatternMismatchScalar(const char* data, const void* pattern, size_t patternSize, size_t from, size_t count);
+
+void _fillPattern(void* data, const void* pattern, size_t patternSize, size_t count)
+{
+    if (count == 0)
+        return;
+
+    if (_canUseAvx2(patternSize))
+    {
+        _fillPatternAvx2(data, pattern, patternSize, count);
+        return;
+    }
+
+    char* bytes = (char*)data;
+    size_t size = patternSize * count;
+
+    memcpy(bytes, pattern, patternSize);
+
+    for (size_t filled = patternSize; filled < size; filled *= 2)
+        memcpy(bytes + filled, bytes, filled < size - filled ? filled : size - filled);
+}
+
+size_t _findPatternMismatch(const void* data, const void* pattern, size_t patternSize, size_t count)
+{
+    if (count == 0)
+        return 0;
+
+    if (_canUseAvx2(patternSize))
+        return _findPatternMismatchAvx2(data, pattern, patternSize, count);
+
+    const char* bytes = (const char*)data;
+
+    // Every element equals the first one and the first one is the pattern
+    if (memcmp(bytes, pattern, patternSize) == 0 &&
+        memcmp(bytes, bytes + patternSize, patternSize * (count - 1)) == 0)
+        return count;
+
+    return _findPatternMismatchScalar(bytes, pattern, patternSize, 0, count);
+}
+
+static bool _canUseAvx2(size_t patternSize)
+{
+    static const bool hasAvx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+
+    return hasAvx2 && patternSize <= _VECTOR_SIZE && _VECTOR_SIZE % patternSize == 0;
+}
+
+/**
+ * @brief The pattern repeated over a vector, patternSize must divide its size.
+*/
+static inline void _repeatPattern(char* vector, const void* pattern, size_t patternSize)
+{
+    for (size_t i = 0; i < _VECTOR_SIZE; i += patternSize)
+        memcpy(vector + i, pattern, patternSize);
+}
+
+__attribute__((target("avx2")))
+static void _fillPatternAvx2(void* data, const void* pattern, size_t patternSize, size_t count)
+{
+    char repeated[_VECTOR_SIZE] = {};
+    _repeatPattern(repeated, pattern, patternSize);
+
+    __m256i vector = _mm256_loadu_si256((const __m256i*)repeated);
+
+    char* bytes = (char*)data;
+    size_t size = patternSize * count;
+    size_t i = 0;
+
+    for (; i + 4 * _VECTOR_SIZE <= size; i += 4 * _VECTOR_SIZE)
+    {
+        _mm256_storeu_si256((__m256i*)(bytes + i) + 0, vector);
+        _mm256_storeu_si256((__m256i*)(bytes + i) + 1, vector);
+        _mm256_storeu_si256((__m256i*)(bytes + i) + 2, vector);
+        _mm256_storeu_si256((__m256i*)(bytes + i) + 3, vector);
+    }
+
+    for (; i + _VECTOR_SIZE <= size; i += _VECTOR_SIZE)
+        _mm256_storeu_si256((__m256i*)(bytes + i), vector);
+
+    _mm256_zeroupper();
+
+    // Offsets are multiples of the vector size, so the tail starts at an element boundary
+    memcpy(bytes + i, repeated, size - i);
+}
+
+__attribute__((target("avx2")))
+static size_t _findPatternMismatchAvx2(const void* data, const void* pattern, size_t patternSize, size_t count)
+{
+    char repeated[_VECTOR_SIZE] = {};
+    _repeatPattern(repeated, pattern, patternSize);
+
+    __m256i vector = _mm256_loadu_si256((const __m256i*)repeated);
+
+    const char* bytes = (const char*)data;
+    size_t size = patternSize * count;
+    size_t i = 0;
+
+    for (; i + 4 * _VECTOR_SIZE <= size; i += 4 * _VECTOR_SIZE)
+    {
+        const __m256i* block = (const __m256i*)(bytes + i);
+
+        __m256i equal = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(block + 0), vector),
+                             _mm256_cmpeq_epi8(_mm256_loadu_si256(block + 1), vector)),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(block + 2), vector),
+                             _mm256_cmpeq_epi8(_mm256_loadu_si256(block + 3), vector)));
+
+        if ((uint32_t)_mm256_movemask_epi8(equal) != UINT32_MAX)
+            break;
+    }
+
+    for (; i + _VECTOR_SIZE <= size; i += _VECTOR_SIZE)
+    {
+        __m256i equal = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(bytes + i)), vector);
+
+        if ((uint32_t)_mm256_movemask_epi8(equal) != UINT32_MAX)
+            break;
+    }
+
+    _mm256_zeroupper();
+
+    // The mismatching vector or the tail
+    return _findPatternMismatchScalar(bytes, pattern, patternSize, i / patternSize, count);
+}
+
+static size_t _findPatternMismatchScalar(const char* data, const void* pattern, size_t patternSize, size_t from, size_t count)
+{
+    for (size_t i = from; i < count; i++)
+        if (memcmp(data + i * patternSize, pattern, patternSize) != 0)
+            return i;
+
+    return count;
+}
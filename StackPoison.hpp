@@ -0,0 +1,26 @@
+//! @file
+
+#ifndef STACK_POISON_HPP
+#define STACK_POISON_HPP
+
+#include <stddef.h>
+
+/**
+ * @brief Fills count elements of patternSize bytes at data with the pattern.
+ *
+ * Uses AVX2 stores for patterns of 1 to 32 bytes that divide 32 if the CPU has them,
+ * otherwise copies doubling chunks of the already filled part.
+*/
+void _fillPattern(void* data, const void* pattern, size_t patternSize, size_t count);
+
+/**
+ * @brief Returns the index of the first of count elements at data that differs from the pattern.
+ *
+ * Uses AVX2 compares on the same patterns as @see _fillPattern, otherwise
+ * compares the range to itself shifted by one element with memcmp.
+ *
+ * @return the index, count if every element matches.
+*/
+size_t _findPatternMismatch(const void* data, const void* pattern, size_t patternSize, size_t count);
+
+#endif
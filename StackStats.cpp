@@ -0,0 +1,246 @@
+#include <time.h>
+#include <pthread.h>
+#include "Stack.hpp"
+
+extern FILE* LOG_FILE;
+
+/**
+ * @brief Live stacks and the totals of destroyed ones, guarded by mutex.
+*/
+struct _StatsRegistry
+{
+    pthread_mutex_t mutex;
+
+    _StackStatsNode* head;
+    StackStats retired;
+
+    uint64_t periodNs;
+    pthread_t thread;
+    pthread_cond_t wakeUp;
+    bool running;
+};
+
+static _StatsRegistry _STATS = { .mutex = PTHREAD_MUTEX_INITIALIZER, .wakeUp = PTHREAD_COND_INITIALIZER };
+
+static void _statsUnlink(_StackStatsNode* node);
+
+static void _statsAccumulate(StackStats* total, const StackStats* stats);
+
+static StackStats _statsCollect();
+
+static void* _statsDumpThread(void*);
+
+void _statsAttach(_StackStatsNode* node)
+{
+    pthread_mutex_lock(&_STATS.mutex);
+
+    node->prev = NULL;
+    node->next = _STATS.head;
+
+    if (_STATS.head)
+        _STATS.head->prev = node;
+
+    _STATS.head = node;
+
+    pthread_mutex_unlock(&_STATS.mutex);
+}
+
+void _statsDetach(_StackStatsNode* node)
+{
+    pthread_mutex_lock(&_STATS.mutex);
+    _statsUnlink(node);
+    pthread_mutex_unlock(&_STATS.mutex);
+}
+
+void _statsDetachRange(const void* begin, const void* end)
+{
+    pthread_mutex_lock(&_STATS.mutex);
+
+    _StackStatsNode* node = _STATS.head;
+
+    while (node)
+    {
+        _StackStatsNode* next = node->next;
+
+        if ((const void*)node >= begin && (const void*)node < end)
+            _statsUnlink(node);
+
+        node = next;
+    }
+
+    pthread_mutex_unlock(&_STATS.mutex);
+}
+
+StackStats _statsLoad(const StackStats* counters)
+{
+    StackStats stats = {};
+
+    stats.pushes              = __atomic_load_n(&counters->pushes,              __ATOMIC_RELAXED);
+    stats.pops                = __atomic_load_n(&counters->pops,                __ATOMIC_RELAXED);
+    stats.growReallocations   = __atomic_load_n(&counters->growReallocations,   __ATOMIC_RELAXED);
+    stats.shrinkReallocations = __atomic_load_n(&counters->shrinkReallocations, __ATOMIC_RELAXED);
+    stats.bytesCopied         = __atomic_load_n(&counters->bytesCopied,         __ATOMIC_RELAXED);
+    stats.integrityChecks     = __atomic_load_n(&counters->integrityChecks,     __ATOMIC_RELAXED);
+    stats.fastIntegrityChecks = __atomic_load_n(&counters->fastIntegrityChecks, __ATOMIC_RELAXED);
+    stats.hashCheckCycles     = __atomic_load_n(&counters->hashCheckCycles,     __ATOMIC_RELAXED);
+    stats.canaryCheckCycles   = __atomic_load_n(&counters->canaryCheckCycles,   __ATOMIC_RELAXED);
+    stats.maxDepth            = __atomic_load_n(&counters->maxDepth,            __ATOMIC_RELAXED);
+
+    return stats;
+}
+
+StackStats StackGetGlobalStats()
+{
+    pthread_mutex_lock(&_STATS.mutex);
+    StackStats stats = _statsCollect();
+    pthread_mutex_unlock(&_STATS.mutex);
+
+    return stats;
+}
+
+void StackStatsPrint(FILE* where, const char* name, const StackStats* stats)
+{
+    MyAssertHard(where, ERROR_BAD_FILE, );
+    MyAssertHard(stats, ERROR_NULLPTR, );
+
+    fprintf(where, "%s: pushes = %zu, pops = %zu, grow reallocations = %zu, shrink reallocations = %zu, "
+                   "bytes copied = %zu, integrity checks = %zu, fast integrity checks = %zu, "
+                   "hash check cycles = %llu, canary check cycles = %llu, max depth = %zu\n",
+            name ? name : "Stack stats", stats->pushes, stats->pops, stats->growReallocations,
+            stats->shrinkReallocations, stats->bytesCopied, stats->integrityChecks, stats->fastIntegrityChecks,
+            (unsigned long long)stats->hashCheckCycles, (unsigned long long)stats->canaryCheckCycles,
+            stats->maxDepth);
+}
+
+ErrorCode StackStatsDumpStart(uint64_t periodNs)
+{
+    pthread_mutex_lock(&_STATS.mutex);
+
+    if (_STATS.running)
+    {
+        pthread_mutex_unlock(&_STATS.mutex);
+        return ERROR_BAD_VALUE;
+    }
+
+    _STATS.periodNs = periodNs ? periodNs : DEFAULT_STATS_DUMP_PERIOD_NS;
+    _STATS.running  = true;
+
+    ErrorCode error = EVERYTHING_FINE;
+
+    if (pthread_create(&_STATS.thread, NULL, _statsDumpThread, NULL) != 0)
+    {
+        _STATS.running = false;
+        error = ERROR_NO_MEMORY;
+    }
+
+    pthread_mutex_unlock(&_STATS.mutex);
+
+    return error;
+}
+
+ErrorCode StackStatsDumpStop()
+{
+    pthread_mutex_lock(&_STATS.mutex);
+
+    if (!_STATS.running)
+    {
+        pthread_mutex_unlock(&_STATS.mutex);
+        return EVERYTHING_FINE;
+    }
+
+    _STATS.running = false;
+    pthread_cond_signal(&_STATS.wakeUp);
+
+    pthread_mutex_unlock(&_STATS.mutex);
+
+    pthread_join(_STATS.thread, NULL);
+
+    return EVERYTHING_FINE;
+}
+
+/**
+ * @brief Moves the counters of a node to the retired ones and unlinks it, must be called under the registry mutex.
+*/
+static void _statsUnlink(_StackStatsNode* node)
+{
+    StackStats counters = _statsLoad(&node->counters);
+    _statsAccumulate(&_STATS.retired, &counters);
+
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        _STATS.head = node->next;
+
+    if (node->next)
+        node->next->prev = node->prev;
+
+    node->prev = NULL;
+    node->next = NULL;
+}
+
+static void _statsAccumulate(StackStats* total, const StackStats* stats)
+{
+    total->pushes              += stats->pushes;
+    total->pops                += stats->pops;
+    total->growReallocations   += stats->growReallocations;
+    total->shrinkReallocations += stats->shrinkReallocations;
+    total->bytesCopied         += stats->bytesCopied;
+    total->integrityChecks     += stats->integrityChecks;
+    total->fastIntegrityChecks += stats->fastIntegrityChecks;
+    total->hashCheckCycles     += stats->hashCheckCycles;
+    total->canaryCheckCycles   += stats->canaryCheckCycles;
+
+    if (total->maxDepth < stats->maxDepth)
+        total->maxDepth = stats->maxDepth;
+}
+
+/**
+ * @brief Sums the retired and live counters, must be called under the registry mutex.
+*/
+static StackStats _statsCollect()
+{
+    StackStats total = _STATS.retired;
+
+    for (_StackStatsNode* node = _STATS.head; node; node = node->next)
+    {
+        StackStats counters = _statsLoad(&node->counters);
+        _statsAccumulate(&total, &counters);
+    }
+
+    return total;
+}
+
+/**
+ * @brief Dumps the global counters every period and once more when stopped.
+*/
+static void* _statsDumpThread(void*)
+{
+    pthread_mutex_lock(&_STATS.mutex);
+
+    while (true)
+    {
+        StackStats stats = _statsCollect();
+
+        if (LOG_FILE)
+        {
+            StackStatsPrint(LOG_FILE, "Global stack stats", &stats);
+            fflush(LOG_FILE);
+        }
+
+        if (!_STATS.running)
+            break;
+
+        timespec deadline = {};
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        uint64_t nsec = (uint64_t)deadline.tv_nsec + _STATS.periodNs;
+        deadline.tv_sec  += (time_t)(nsec / 1000000000);
+        deadline.tv_nsec  = (long)(nsec % 1000000000);
+
+        pthread_cond_timedwait(&_STATS.wakeUp, &_STATS.mutex, &deadline);
+    }
+
+    pthread_mutex_unlock(&_STATS.mutex);
+
+    return NULL;
+}
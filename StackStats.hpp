@@ -0,0 +1,111 @@
+//! @file
+
+#ifndef STACK_STATS_HPP
+#define STACK_STATS_HPP
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "Utils.hpp"
+
+/**
+ * @brief Operation counters of a stack or of all stacks, @see StackGetStats.
+ *
+ * Counted only if STACK_STATS is defined (-DSTACK_STATS), otherwise every counter stays 0
+ * and the operations do not touch them.
+ * Times are TSC cycles estimated from one in STACK_STATS_TIME_SAMPLE checks.
+ *
+ * @var StackStats::pushes - pushed elements, batches included.
+ * @var StackStats::pops - popped elements, batches included.
+ * @var StackStats::growReallocations - buffer reallocations to a bigger capacity.
+ * @var StackStats::shrinkReallocations - buffer reallocations to a smaller capacity.
+ * @var StackStats::bytesCopied - bytes copied to a new buffer, mremap and in place realloc copy none.
+ * @var StackStats::integrityChecks - full checks, @see CheckStackIntegrity.
+ * @var StackStats::fastIntegrityChecks - O(1) checks done by Push, Pop and the rest.
+ * @var StackStats::hashCheckCycles - spent checking the stack and data hashes.
+ * @var StackStats::canaryCheckCycles - spent checking the canaries.
+ * @var StackStats::maxDepth - the biggest size reached.
+ */
+struct StackStats
+{
+    size_t pushes;
+    size_t pops;
+    size_t growReallocations;
+    size_t shrinkReallocations;
+    size_t bytesCopied;
+    size_t integrityChecks;
+    size_t fastIntegrityChecks;
+    uint64_t hashCheckCycles;
+    uint64_t canaryCheckCycles;
+    size_t maxDepth;
+};
+
+/**
+ * @brief Counters of a live stack linked into the list of all of them.
+ *
+ * Only the owner thread writes the counters, others read them with relaxed loads.
+ * timedChecks picks the checks whose time is sampled.
+*/
+struct _StackStatsNode
+{
+    StackStats counters;
+    size_t timedChecks;
+
+    _StackStatsNode* prev;
+    _StackStatsNode* next;
+};
+
+/**
+ * @brief Adds the counters of a new stack to the global ones.
+*/
+void _statsAttach(_StackStatsNode* node);
+
+/**
+ * @brief Removes the counters of a destroyed stack, the global counters keep its totals.
+*/
+void _statsDetach(_StackStatsNode* node);
+
+/**
+ * @brief Detaches the counters of every stack whose header lies in [begin, end),
+ * used when that memory is freed without destroying the stacks, @see StackArenaDestroy.
+*/
+void _statsDetachRange(const void* begin, const void* end);
+
+/**
+ * @brief Reads counters that their owner may be writing.
+*/
+StackStats _statsLoad(const StackStats* counters);
+
+/**
+ * @brief Returns the counters of every stack created so far, live or destroyed.
+ *
+ * maxDepth is the biggest one of a single stack.
+*/
+StackStats StackGetGlobalStats();
+
+/**
+ * @brief Prints the counters as one line.
+ *
+ * @param [in] where - the file.
+ * @param [in] name - printed before the counters.
+ * @param [in] stats - the counters.
+*/
+void StackStatsPrint(FILE* where, const char* name, const StackStats* stats);
+
+/**
+ * @brief Starts a thread that prints @see StackGetGlobalStats to the log file every periodNs.
+ *
+ * @param [in] periodNs - time between dumps, @see DEFAULT_STATS_DUMP_PERIOD_NS if 0.
+ *
+ * @return @see @enum ErrorCode, ERROR_BAD_VALUE if it is already running.
+*/
+ErrorCode StackStatsDumpStart(uint64_t periodNs);
+
+/**
+ * @brief Stops the stats dump thread and waits for it, the counters are dumped one last time.
+ *
+ * @return @see @enum ErrorCode.
+*/
+ErrorCode StackStatsDumpStop();
+
+#endif
@@ -0,0 +1,79 @@
+//! @file
+
+#ifndef STACK_TRAITS_HPP
+#define STACK_TRAITS_HPP
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <type_traits>
+
+/**
+ * @brief Tells if a stack of T can be hashed and poisoned bytewise.
+ *
+ * Other types are moved on reallocation and support only canary protection.
+*/
+template <typename T>
+constexpr bool STACK_TRIVIAL = std::is_trivially_copyable<T>::value;
+
+/**
+ * @brief Describes the poison value and dump format of stack elements.
+ *
+ * By default poison is T filled with 0xBE bytes and elements are dumped as raw bytes.
+ * Use @see STACK_TRAITS to give a type readable ones. Specifier is the printf
+ * specifier the binary dump decoder renders elements with, NULL for raw bytes.
+ *
+ * @note Poison is only used for @see STACK_TRIVIAL types.
+*/
+template <typename T>
+struct StackTraits
+{
+    static T Poison()
+    {
+        T poison;
+        memset((void*)&poison, 0xBE, sizeof(T));
+
+        return poison;
+    }
+
+    static const char* Specifier() { return NULL; }
+
+    static void Print(FILE* where, const T& value)
+    {
+        const unsigned char* bytes = (const unsigned char*)&value;
+
+        fprintf(where, "0x");
+        for (size_t i = 0; i < sizeof(T); i++)
+            fprintf(where, "%02x", bytes[i]);
+    }
+};
+
+/**
+ * @brief Defines @see StackTraits for a type.
+ *
+ * @param [in] type - element type.
+ * @param [in] poison - value of unused slots.
+ * @param [in] specifier - printf specifier for the dump.
+*/
+#define STACK_TRAITS(type, poison, specifier)                                                                       \
+template <>                                                                                                         \
+struct StackTraits<type>                                                                                            \
+{                                                                                                                   \
+    static type Poison() { return poison; }                                                                         \
+                                                                                                                    \
+    static const char* Specifier() { return specifier; }                                                            \
+                                                                                                                    \
+    static void Print(FILE* where, const type& value) { fprintf(where, specifier, value); }                        \
+}
+
+STACK_TRAITS(int,                INT32_MAX,  "%d");
+STACK_TRAITS(unsigned int,       UINT32_MAX, "%u");
+STACK_TRAITS(long,               INT64_MAX,  "%ld");
+STACK_TRAITS(unsigned long,      UINT64_MAX, "%lu");
+STACK_TRAITS(long long,          INT64_MAX,  "%lld");
+STACK_TRAITS(unsigned long long, UINT64_MAX, "%llu");
+STACK_TRAITS(float,              FLT_MAX,    "%g");
+STACK_TRAITS(double,             DBL_MAX,    "%lg");
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include "../Stack.hpp"
+#include "../StackImpl.hpp"
+
+/**
+ * @brief Checks that the auditor reports a stack whose header was corrupted
+ * and then written by its owner, which must not sign the corrupted header again.
+ *
+ * Usage: AuditTest, exits with 0 if the corruption was reported.
+*/
+
+struct _AuditReport
+{
+    void* stack;
+    ErrorCode error;
+    size_t calls;
+};
+
+static void _auditCallback(void* stack, ErrorCode error, void* context)
+{
+    _AuditReport* report = (_AuditReport*)context;
+
+    report->stack = stack;
+    report->error = error;
+    report->calls++;
+}
+
+int main()
+{
+    #ifndef HASH_PROTECTION
+    printf("SKIPPED: only the stack hash covers the header\n");
+    return 0;
+    #endif
+
+    StackResult<int> stackResult = StackInit(int);
+
+    if (stackResult.error)
+    {
+        fprintf(stderr, "%s\n", ERROR_CODE_NAMES[stackResult.error]);
+        return stackResult.error;
+    }
+
+    Stack<int>* stack = stackResult.value;
+
+    for (int i = 0; i < 5; i++)
+        Push(stack, i);
+
+    _AuditReport report = {};
+
+    // The callback stays set after the thread stops, passes are run here with StackAuditRun
+    StackAuditStart(0, _auditCallback, &report);
+    StackAuditStop();
+
+    StackAuditRegister(stack);
+
+    StackAuditRun();
+
+    if (report.calls != 0)
+    {
+        fprintf(stderr, "FAILED: a fine stack was reported with %s\n", ERROR_CODE_NAMES[report.error]);
+        return 1;
+    }
+
+    // Corrupt the header behind the owner's back, then let the owner write once
+    stack->reservedCapacity = 77;
+    stack->growthPolicy.minCapacity = 3;
+
+    Push(stack, 5);
+
+    StackAuditRun();
+
+    if (report.calls != 1 || report.stack != (void*)stack || report.error == EVERYTHING_FINE)
+    {
+        fprintf(stderr, "FAILED: the callback was called %zu times for a corrupted header\n", report.calls);
+        return 1;
+    }
+
+    printf("OK: the auditor reported %s\n", ERROR_CODE_NAMES[report.error]);
+
+    return 0;
+}
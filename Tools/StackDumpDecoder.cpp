@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../Stack.hpp"
+
+/**
+ * @brief Renders binary stack dumps in a log file as the text dump, other text is copied as is.
+ *
+ * Like the text dump, the first 4096 slots are printed, the rest only counted.
+ * Usage: StackDumpDecoder [log file] [max slots], log.txt and 4096 if omitted, 0 prints every slot.
+*/
+
+/**
+ * @brief Record with pointers to its parts, filled by @see _parseRecord.
+*/
+struct _DumpView
+{
+    _StackDumpRecord record;
+
+    const char* originFile;
+    const char* originName;
+    const char* callerFile;
+    const char* callerName;
+    const char* specifier;
+
+    const unsigned char* blockHashes;
+    const unsigned char* poison;
+    const unsigned char* data;
+};
+
+static bool _parseRecord(const char* begin, size_t available, _DumpView* view);
+
+static void _printRecord(FILE* where, const _DumpView* view, size_t maxSlots);
+
+static void _printElement(FILE* where, const _DumpView* view, const unsigned char* element);
+
+static void _printCanary(FILE* where, const char* name, uint64_t canary, uint64_t expected);
+
+int main(int argc, const char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : logFilePath;
+    size_t maxSlots  = argc > 2 ? strtoull(argv[2], NULL, 10) : 4096;
+
+    if (maxSlots == 0)
+        maxSlots = SIZE_MAX;
+
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return ERROR_BAD_FILE;
+    }
+
+    struct stat fileStat = {};
+    fstat(fd, &fileStat);
+
+    size_t fileSize = (size_t)fileStat.st_size;
+
+    if (fileSize == 0)
+        return 0;
+
+    const char* file = (const char*)mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (file == MAP_FAILED)
+    {
+        fprintf(stderr, "Can't map %s\n", path);
+        return ERROR_NO_MEMORY;
+    }
+
+    const char* position = file;
+    const char* fileEnd = file + fileSize;
+
+    while (position < fileEnd)
+    {
+        const char* magic = (const char*)memmem(position, (size_t)(fileEnd - position),
+                                                &STACK_DUMP_MAGIC, sizeof(STACK_DUMP_MAGIC));
+
+        if (!magic)
+            magic = fileEnd;
+
+        fwrite(position, 1, (size_t)(magic - position), stdout);
+
+        if (magic == fileEnd)
+            break;
+
+        _DumpView view = {};
+
+        if (!_parseRecord(magic, (size_t)(fileEnd - magic), &view))
+        {
+            // A truncated record, or the magic bytes by chance
+            fwrite(magic, 1, sizeof(STACK_DUMP_MAGIC), stdout);
+            position = magic + sizeof(STACK_DUMP_MAGIC);
+
+            continue;
+        }
+
+        _printRecord(stdout, &view, maxSlots);
+
+        position = magic + view.record.recordSize;
+    }
+
+    munmap((void*)file, fileSize);
+
+    return 0;
+}
+
+static bool _parseRecord(const char* begin, size_t available, _DumpView* view)
+{
+    if (available < sizeof(_StackDumpRecord))
+        return false;
+
+    _StackDumpRecord* record = &view->record;
+    memcpy(record, begin, sizeof(*record));
+
+    if (record->recordSize > available || record->elementSize == 0 || record->protection > STACK_PROTECTION_PARANOID ||
+        record->error >= sizeof(ERROR_CODE_NAMES) / sizeof(ERROR_CODE_NAMES[0]))
+        return false;
+
+    size_t stringsSize = (size_t)record->originFileLength + record->originNameLength +
+                         record->callerFileLength + record->callerNameLength + record->specifierLength;
+
+    if (record->highWaterMark > record->capacity || record->highWaterMark > available / record->elementSize ||
+        record->blocksCount > available ||
+        record->recordSize != sizeof(*record) + stringsSize + record->blocksCount * 2 * sizeof(uint32_t) +
+                              (1 + record->highWaterMark) * record->elementSize)
+        return false;
+
+    const char* part = begin + sizeof(*record);
+
+    view->originFile = part;  part += record->originFileLength;
+    view->originName = part;  part += record->originNameLength;
+    view->callerFile = part;  part += record->callerFileLength;
+    view->callerName = part;  part += record->callerNameLength;
+    view->specifier  = part;  part += record->specifierLength;
+
+    view->blockHashes = (const unsigned char*)part;  part += record->blocksCount * 2 * sizeof(uint32_t);
+    view->poison      = (const unsigned char*)part;  part += record->elementSize;
+    view->data        = (const unsigned char*)part;
+
+    return true;
+}
+
+static void _printRecord(FILE* where, const _DumpView* view, size_t maxSlots)
+{
+    const _StackDumpRecord* record = &view->record;
+
+    fprintf(where, "Stack[%p] from %.*s(%llu) %.*s()\n", (void*)(uintptr_t)record->stack,
+            (int)record->originFileLength, view->originFile, (unsigned long long)record->originLine,
+            (int)record->originNameLength, view->originName);
+    fprintf(where, "called from %.*s(%llu) %.*s()\n",
+            (int)record->callerFileLength, view->callerFile, (unsigned long long)record->callerLine,
+            (int)record->callerNameLength, view->callerName);
+    fprintf(where, "Stack condition - %s\n", ERROR_CODE_NAMES[record->error]);
+    fprintf(where, "Stack protection - %s\n", STACK_PROTECTION_NAMES[record->protection]);
+    fprintf(where, "Operations since last verification = %llu\n", (unsigned long long)record->opsSinceVerified);
+
+    if (record->flags & _STACK_DUMP_HASH)
+    {
+        fprintf(where, "Data hash = %u", record->hashData);
+        if (record->hashData != record->expectedHashData)
+            fprintf(where, " INVALID!!! SHOULD BE %u", record->expectedHashData);
+        fprintf(where, "\n");
+
+        for (size_t block = 0; block < record->blocksCount; block++)
+        {
+            uint32_t blockHashes[2] = {};
+            memcpy(blockHashes, view->blockHashes + block * sizeof(blockHashes), sizeof(blockHashes));
+
+            if (blockHashes[0] != blockHashes[1])
+                fprintf(where, "Data block %zu [%llu, %llu) hash = %u INVALID!!! SHOULD BE %u\n",
+                        block, (unsigned long long)(block * record->blockSize),
+                        (unsigned long long)min((block + 1) * record->blockSize, record->capacity),
+                        blockHashes[0], blockHashes[1]);
+        }
+
+        fprintf(where, "Stack hash = %u", record->hashStack);
+        if (record->hashStack != record->expectedHashStack)
+            fprintf(where, " INVALID!!! SHOULD BE %u", record->expectedHashStack);
+        fprintf(where, "\n");
+    }
+
+    if (record->flags & _STACK_DUMP_CANARY)
+    {
+        _printCanary(where, "Left stack canary",  record->leftCanary,  record->expectedCanary);
+        _printCanary(where, "Right stack canary", record->rightCanary, record->expectedCanary);
+    }
+
+    fprintf(where, "{\n");
+    fprintf(where, "    size = %llu\n", (unsigned long long)record->size);
+    fprintf(where, "    capacity = %llu\n", (unsigned long long)record->capacity);
+    fprintf(where, "    high-water mark = %llu\n", (unsigned long long)record->highWaterMark);
+    fprintf(where, "    reserved capacity = %llu\n", (unsigned long long)record->reservedCapacity);
+    fprintf(where, "    reallocations = %llu\n", (unsigned long long)record->reallocations);
+    fprintf(where, "    growth policy = {grow factor = %llu, shrink divisor = %llu, min capacity = %llu%s}\n",
+            (unsigned long long)record->growFactor, (unsigned long long)record->shrinkDivisor,
+            (unsigned long long)record->minCapacity, record->flags & _STACK_DUMP_NOSHRINK ? ", no shrink" : "");
+    fprintf(where, "    data[%p]%s\n", (void*)(uintptr_t)record->data,
+            record->flags & _STACK_DUMP_GUARDED ? " between guard pages" :
+            record->mappedSize                  ? " in huge pages"       : "");
+    if (record->mappedSize)
+        fprintf(where, "    mapped size = %llu\n", (unsigned long long)record->mappedSize);
+
+    if (record->flags & _STACK_DUMP_CANARY)
+        _printCanary(where, "    Left data canary", record->leftDataCanary, record->expectedCanary);
+
+    size_t printedSlots = min((size_t)record->capacity, maxSlots);
+
+    for (size_t i = 0; i < printedSlots; i++)
+    {
+        const unsigned char* element = view->data + i * record->elementSize;
+
+        fprintf(where, "    ");
+
+        if (i < record->highWaterMark && memcmp(element, view->poison, record->elementSize) != 0)
+        {
+            fprintf(where, "*[%zu] = ", i);
+            _printElement(where, view, element);
+            fprintf(where, "\n");
+        }
+        else
+            fprintf(where, " [%zu] = POISON\n", i);
+    }
+
+    if (printedSlots < record->capacity)
+    {
+        size_t writtenSlots = 0;
+
+        for (size_t i = printedSlots; i < record->highWaterMark; i++)
+            if (memcmp(view->data + i * record->elementSize, view->poison, record->elementSize) != 0)
+                writtenSlots++;
+
+        fprintf(where, "    ... %llu more slots, %zu of them not POISON\n",
+                (unsigned long long)(record->capacity - printedSlots), writtenSlots);
+    }
+
+    if (record->flags & _STACK_DUMP_CANARY)
+        _printCanary(where, "    Right data canary", record->rightDataCanary, record->expectedCanary);
+
+    fprintf(where, "}\n\n\n");
+}
+
+/**
+ * @brief Prints an element with the dumped specifier, or as raw bytes like the default @see StackTraits.
+*/
+static void _printElement(FILE* where, const _DumpView* view, const unsigned char* element)
+{
+    size_t elementSize = view->record.elementSize;
+    char conversion = view->record.specifierLength ? view->specifier[view->record.specifierLength - 1] : 0;
+
+    if ((conversion == 'd' || conversion == 'i') && elementSize <= sizeof(int64_t))
+    {
+        int64_t value = 0;
+        memcpy(&value, element, elementSize);
+
+        // Sign extend from elementSize bytes
+        size_t shift = 8 * (sizeof(value) - elementSize);
+        value = (int64_t)((uint64_t)value << shift) >> shift;
+
+        fprintf(where, "%lld", (long long)value);
+    }
+    else if ((conversion == 'u' || conversion == 'x') && elementSize <= sizeof(uint64_t))
+    {
+        uint64_t value = 0;
+        memcpy(&value, element, elementSize);
+
+        fprintf(where, conversion == 'u' ? "%llu" : "%llx", (unsigned long long)value);
+    }
+    else if ((conversion == 'g' || conversion == 'f' || conversion == 'e') &&
+             (elementSize == sizeof(float) || elementSize == sizeof(double)))
+    {
+        double value = 0;
+
+        if (elementSize == sizeof(float))
+        {
+            float floatValue = 0;
+            memcpy(&floatValue, element, sizeof(floatValue));
+
+            value = floatValue;
+        }
+        else
+            memcpy(&value, element, sizeof(value));
+
+        char format[] = "%g";
+        format[1] = conversion;
+
+        fprintf(where, format, value);
+    }
+    else
+    {
+        fprintf(where, "0x");
+        for (size_t i = 0; i < elementSize; i++)
+            fprintf(where, "%02x", element[i]);
+    }
+}
+
+static void _printCanary(FILE* where, const char* name, uint64_t canary, uint64_t expected)
+{
+    fprintf(where, "%s = %llu", name, (unsigned long long)canary);
+    if (canary != expected)
+        fprintf(where, " INVALID!!! SHOULD BE %llu", (unsigned long long)expected);
+    fprintf(where, "\n");
+}
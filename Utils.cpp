@@ -5,13 +5,14 @@
 #include <time.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <immintrin.h>
 #include "Utils.hpp"
 
 const double ABSOLUTE_TOLERANCE = 1e-5;
 
 bool IsEqual(const double x1, const double x2)
 {
-	return fabs(x1 - x2) < ABSOLUTE_TOLERANCE;
+    return fabs(x1 - x2) < ABSOLUTE_TOLERANCE;
 }
 
 void Swap(void* a, void* b, size_t size)
@@ -29,21 +30,21 @@ void Swap(void* a, void* b, size_t size)
 
 void ClearBuffer(FILE* where)
 {
-	int c = fgetc(where);
-	while (c != '\n' && c != EOF) { c = fgetc(where); }
+    int c = fgetc(where);
+    while (c != '\n' && c != EOF) { c = fgetc(where); }
 }
 
 bool CheckInput(FILE* where)
 {
-	int c = fgetc(where);
-	while (c == ' ' || c == '\t') { c = fgetc(where); }
+    int c = fgetc(where);
+    while (c == ' ' || c == '\t') { c = fgetc(where); }
 
-	return c == '\n';
+    return c == '\n';
 }
 
 void SetConsoleColor(FILE* where, enum Color color)
 {
-	fprintf(where, "\033[0;%dm", (int)color);
+    fprintf(where, "\033[0;%dm", (int)color);
 }
 
 size_t GetFileSize(const char* path)
@@ -58,50 +59,340 @@ size_t GetFileSize(const char* path)
 
 #define mmix(h, k) do { k *= m; k ^= k >> r; k *= m; h *= m; h ^= k; } while (0)
 
+typedef unsigned int (*_HashFunction)(const void *key, size_t len, unsigned int seed);
+
+static unsigned int _calculateHashMurmur(const void *key, size_t len, unsigned int seed);
+
+static unsigned int _calculateHashCrc32c(const void *key, size_t len, unsigned int seed);
+
+static unsigned int _calculateHashAvx2(const void *key, size_t len, unsigned int seed);
+
+static unsigned int _resolveHash(const void *key, size_t len, unsigned int seed);
+
+static unsigned int _profileHash(const void *key, size_t len, unsigned int seed);
+
+static const _HashFunction _HASH_FUNCTIONS[] =
+{
+    NULL, _calculateHashMurmur, _calculateHashCrc32c, _calculateHashAvx2,
+};
+
+/**
+ * @brief Backends in the order of preference for @see HASH_BACKEND_AUTO.
+ */
+static const enum HashBackend _HASH_BACKENDS_BY_SPEED[] =
+{
+    HASH_BACKEND_AVX2, HASH_BACKEND_CRC32C, HASH_BACKEND_MURMUR,
+};
+
+static _HashFunction _HASH_FUNCTION = _resolveHash;
+
+static enum HashBackend _HASH_BACKEND = HASH_BACKEND_AUTO;
+
+static bool _HASH_PROFILING = false;
+
+/**
+ * @brief Cycles of two back to back rdtsc, subtracted from every profiled call.
+ */
+static uint64_t _RDTSC_OVERHEAD = 0;
+
+static __thread uint64_t _HASH_CYCLES = 0;
+
 unsigned int CalculateHash(const void *key, size_t len, unsigned int seed)
 {
-	const unsigned int m = 0x5bd1e995;
-	const int r = 24;
-	unsigned int l = (unsigned int)len;
+    return __atomic_load_n(&_HASH_FUNCTION, __ATOMIC_RELAXED)(key, len, seed);
+}
+
+unsigned int CalculatePortableHash(const void *key, size_t len, unsigned int seed)
+{
+    return _calculateHashMurmur(key, len, seed);
+}
+
+unsigned int CalculateBackendHash(enum HashBackend backend, const void *key, size_t len, unsigned int seed)
+{
+    if (!IsHashBackendSupported(backend))
+        return 0;
+
+    return _HASH_FUNCTIONS[backend](key, len, seed);
+}
+
+enum ErrorCode SetHashBackend(enum HashBackend backend)
+{
+    if (backend == HASH_BACKEND_AUTO)
+    {
+        for (size_t i = 0; i < sizeof(_HASH_BACKENDS_BY_SPEED) / sizeof(_HASH_BACKENDS_BY_SPEED[0]); i++)
+            if (IsHashBackendSupported(_HASH_BACKENDS_BY_SPEED[i]))
+                return SetHashBackend(_HASH_BACKENDS_BY_SPEED[i]);
+    }
+
+    if (!IsHashBackendSupported(backend))
+        return ERROR_BAD_VALUE;
+
+    __atomic_store_n(&_HASH_BACKEND, backend, __ATOMIC_RELAXED);
+    __atomic_store_n(&_HASH_FUNCTION, _HASH_PROFILING ? _profileHash : _HASH_FUNCTIONS[backend], __ATOMIC_RELAXED);
+
+    return EVERYTHING_FINE;
+}
+
+enum HashBackend GetHashBackend()
+{
+    if (__atomic_load_n(&_HASH_BACKEND, __ATOMIC_RELAXED) == HASH_BACKEND_AUTO)
+        SetHashBackend(HASH_BACKEND_AUTO);
+
+    return __atomic_load_n(&_HASH_BACKEND, __ATOMIC_RELAXED);
+}
+
+void SetHashProfiling(bool on)
+{
+    const size_t calibrationRuns = 1000;
+
+    HashBackend backend = GetHashBackend();
+
+    if (on)
+    {
+        uint64_t overhead = UINT64_MAX;
+
+        for (size_t i = 0; i < calibrationRuns; i++)
+        {
+            uint64_t begin = __rdtsc();
+            uint64_t cycles = __rdtsc() - begin;
+
+            if (cycles < overhead)
+                overhead = cycles;
+        }
+
+        _RDTSC_OVERHEAD = overhead;
+        _HASH_CYCLES = 0;
+    }
+
+    _HASH_PROFILING = on;
+    __atomic_store_n(&_HASH_FUNCTION, on ? _profileHash : _HASH_FUNCTIONS[backend], __ATOMIC_RELAXED);
+}
+
+uint64_t GetHashCycles()
+{
+    return _HASH_CYCLES;
+}
+
+/**
+ * @brief Value of @see _HASH_FUNCTION while profiling, times the current backend.
+ */
+static unsigned int _profileHash(const void *key, size_t len, unsigned int seed)
+{
+    uint64_t begin = __rdtsc();
+
+    unsigned int hash = _HASH_FUNCTIONS[__atomic_load_n(&_HASH_BACKEND, __ATOMIC_RELAXED)](key, len, seed);
+
+    uint64_t cycles = __rdtsc() - begin;
+    _HASH_CYCLES += cycles > _RDTSC_OVERHEAD ? cycles - _RDTSC_OVERHEAD : 0;
+
+    return hash;
+}
+
+/**
+ * @brief First value of @see _HASH_FUNCTION, picks the backend and hashes with it.
+ * 
+ * Works before static constructors, so stacks created by them are hashed with the same backend.
+ */
+static unsigned int _resolveHash(const void *key, size_t len, unsigned int seed)
+{
+    GetHashBackend();
 
-	const unsigned char* data = (const unsigned char *)key;
+    return CalculateHash(key, len, seed);
+}
+
+bool IsHashBackendSupported(enum HashBackend backend)
+{
+    __builtin_cpu_init();
+
+    switch (backend)
+    {
+        case HASH_BACKEND_MURMUR:
+            return true;
+        case HASH_BACKEND_CRC32C:
+            return __builtin_cpu_supports("sse4.2");
+        case HASH_BACKEND_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+        case HASH_BACKEND_AUTO:
+        default:
+            return false;
+    }
+}
 
-	unsigned int h = seed;
-	unsigned int k;
+static inline unsigned int _mixHash(unsigned int h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
 
-	while(len >= 4)
-	{
-		k = *(unsigned int*)data;
+    return h;
+}
+
+static unsigned int _calculateHashMurmur(const void *key, size_t len, unsigned int seed)
+{
+    const unsigned int m = 0x5bd1e995;
+    const int r = 24;
+    unsigned int l = (unsigned int)len;
+
+    const unsigned char* data = (const unsigned char *)key;
+
+    unsigned int h = seed;
+    unsigned int k;
+
+    while(len >= 4)
+    {
+        memcpy(&k, data, sizeof(k));
 
-		mmix(h,k);
+        mmix(h,k);
 
-		data += 4;
-		len -= 4;
-	}
+        data += 4;
+        len -= 4;
+    }
+
+    unsigned int t = 0;
+
+    switch(len)
+    {
+    case 3:
+        t ^= (unsigned int)(data[2] << 16);
+        break;
+    case 2:
+        t ^= (unsigned int)(data[1] << 8);
+        break;
+    case 1:
+        t ^= data[0];
+        break;
+    default:
+        break;
+    };
+
+    mmix(h,t);
+    mmix(h,l);
+
+    h ^= h >> 13;
+    h *= m;
+    h ^= h >> 15;
+
+    return h;
+}
+
+/**
+ * @brief CRC32C of three interleaved streams of 8 byte words, chained at the end.
+ * 
+ * CRC is linear, so the result goes through a multiply-xorshift finalizer.
+ */
+__attribute__((target("sse4.2")))
+static unsigned int _calculateHashCrc32c(const void *key, size_t len, unsigned int seed)
+{
+    const unsigned char* data = (const unsigned char *)key;
+    uint64_t a = seed, b = seed ^ 0x9E3779B9, c = seed ^ 0x7F4A7C15;
+    uint64_t words[3] = {};
+
+    for (; len >= sizeof(words); data += sizeof(words), len -= sizeof(words))
+    {
+        memcpy(words, data, sizeof(words));
+
+        a = __builtin_ia32_crc32di(a, words[0]);
+        b = __builtin_ia32_crc32di(b, words[1]);
+        c = __builtin_ia32_crc32di(c, words[2]);
+    }
+
+    unsigned int h = __builtin_ia32_crc32si(__builtin_ia32_crc32si((unsigned int)a, (unsigned int)b), (unsigned int)c);
+
+    for (; len >= sizeof(words[0]); data += sizeof(words[0]), len -= sizeof(words[0]))
+    {
+        memcpy(words, data, sizeof(words[0]));
+        h = (unsigned int)__builtin_ia32_crc32di(h, words[0]);
+    }
+
+    for (; len; data++, len--)
+        h = __builtin_ia32_crc32qi(h, *data);
+
+    return _mixHash(h);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i _avx2Round(__m256i acc, __m256i value, __m256i key)
+{
+    __m256i keyed = _mm256_xor_si256(value, key);
+    __m256i product = _mm256_mul_epu32(keyed, _mm256_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+
+    return _mm256_add_epi64(acc, _mm256_add_epi64(product, _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2))));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i _avx2Scramble(__m256i acc, __m256i key)
+{
+    const __m256i prime = _mm256_set1_epi32((int)0x9E3779B1);
+
+    acc = _mm256_xor_si256(_mm256_xor_si256(acc, _mm256_srli_epi64(acc, 47)), key);
+
+    __m256i low  = _mm256_mul_epu32(acc, prime);
+    __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(acc, 32), prime);
+
+    return _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+}
+
+/**
+ * @brief XXH3 style multiply-accumulate rounds on 4 accumulators of 4 64 bit lanes, 128 bytes per step.
+ * 
+ * Each lane adds the product of the low and high halves of its keyed input, and the accumulators
+ * are scrambled every scrambleSteps steps. The lanes and the tail are folded with CRC32C,
+ * which also hashes inputs shorter than two steps.
+ */
+__attribute__((target("avx2,sse4.2")))
+static unsigned int _calculateHashAvx2(const void *key, size_t len, unsigned int seed)
+{
+    const size_t stepSize = 4 * sizeof(__m256i);
+    const size_t scrambleSteps = 8;
+
+    if (len < 2 * stepSize)
+        return _calculateHashCrc32c(key, len, seed);
+
+    const unsigned char* data = (const unsigned char *)key;
+    size_t l = len;
+
+    const __m256i baseKey = _mm256_setr_epi32((int)0xB8FE6C39, (int)0x23A44BBE, (int)0x7C01812C, (int)0xF721AD1C,
+                                              (int)0xDED46DE9, (int)0x839097DB, (int)0x7240A4A4, (int)0xB7B3671F);
+
+    // Named accumulators stay in registers, an array of them is kept on the stack
+    __m256i key0 = _mm256_xor_si256(baseKey, _mm256_set1_epi32((int)(seed)));
+    __m256i key1 = _mm256_xor_si256(baseKey, _mm256_set1_epi32((int)(seed + 0x9E3779B9)));
+    __m256i key2 = _mm256_xor_si256(baseKey, _mm256_set1_epi32((int)(seed + 0x3C6EF372)));
+    __m256i key3 = _mm256_xor_si256(baseKey, _mm256_set1_epi32((int)(seed + 0xDAA66D2B)));
+
+    __m256i acc0 = _mm256_set1_epi64x((long long)seed);
+    __m256i acc1 = _mm256_set1_epi64x((long long)seed + 1);
+    __m256i acc2 = _mm256_set1_epi64x((long long)seed + 2);
+    __m256i acc3 = _mm256_set1_epi64x((long long)seed + 3);
+
+    for (size_t step = 1; len >= stepSize; data += stepSize, len -= stepSize, step++)
+    {
+        acc0 = _avx2Round(acc0, _mm256_loadu_si256((const __m256i*)data + 0), key0);
+        acc1 = _avx2Round(acc1, _mm256_loadu_si256((const __m256i*)data + 1), key1);
+        acc2 = _avx2Round(acc2, _mm256_loadu_si256((const __m256i*)data + 2), key2);
+        acc3 = _avx2Round(acc3, _mm256_loadu_si256((const __m256i*)data + 3), key3);
+
+        if (step % scrambleSteps == 0)
+        {
+            acc0 = _avx2Scramble(acc0, key0);
+            acc1 = _avx2Scramble(acc1, key1);
+            acc2 = _avx2Scramble(acc2, key2);
+            acc3 = _avx2Scramble(acc3, key3);
+        }
+    }
 
-	unsigned int t = 0;
+    __m256i lanes = _mm256_xor_si256(_mm256_xor_si256(acc0, _mm256_slli_epi64(acc1, 1)),
+                                     _mm256_xor_si256(_mm256_slli_epi64(acc2, 2), _mm256_slli_epi64(acc3, 3)));
 
-	switch(len)
-	{
-	case 3:
-		t ^= (unsigned int)(data[2] << 16);
-		break;
-	case 2:
-		t ^= (unsigned int)(data[1] << 8);
-		break;
-	case 1:
-		t ^= data[0];
-		break;
-	default: 
-		break;
-	};
+    unsigned int folded[8] = {};
+    _mm256_storeu_si256((__m256i*)folded, lanes);
 
-	mmix(h,t);
-	mmix(h,l);
+    // The rest is SSE code, clean upper halves avoid the transition penalty
+    _mm256_zeroupper();
 
-	h ^= h >> 13;
-	h *= m;
-	h ^= h >> 15;
+    unsigned int h = _calculateHashCrc32c(folded, sizeof(folded), seed ^ (unsigned int)l);
 
-	return h;
+    return _calculateHashCrc32c(data, len, h);
 }
@@ -34,7 +34,7 @@ enum ErrorCode
     ERROR_BAD_VALUE, ERROR_DEAD_CANARY, ERROR_BAD_HASH, ERROR_ZERO_DIVISION,
     ERROR_SYNTAX, ERROR_WRONG_LABEL_SIZE, ERROR_TOO_MANY_LABELS,
     ERROR_NOT_FOUND, ERROR_BAD_FIELDS, ERROR_BAD_TREE, ERROR_NO_ROOT,
-    ERROR_TREE_LOOP, EXIT,
+    ERROR_TREE_LOOP, ERROR_BAD_POISON, EXIT,
 };
 
 static const char* ERROR_CODE_NAMES[] =
@@ -44,7 +44,7 @@ static const char* ERROR_CODE_NAMES[] =
     "ERROR_BAD_VALUE", "ERROR_DEAD_CANARY", "ERROR_BAD_HASH", "ERROR_ZERO_DIVISION",
     "ERROR_SYNTAX", "ERROR_WRONG_LABEL_SIZE", "ERROR_TOO_MANY_LABELS",
     "ERROR_NOT_FOUND", "ERROR_BAD_FIELDS", "ERROR_BAD_TREE", "ERROR_NO_ROOT",
-    "ERROR_TREE_LOOP", "EXIT",
+    "ERROR_TREE_LOOP", "ERROR_BAD_POISON", "EXIT",
 };
 
 static const size_t SIZET_POISON = (size_t)-1;
@@ -199,6 +199,103 @@ void SetConsoleColor(FILE* where, enum Color color);
  */
 size_t GetFileSize(const char* path);
 
+/** @enum HashBackend
+ * @brief Implementation of @see CalculateHash.
+ * 
+ * @var HASH_BACKEND_AUTO - the fastest one the CPU supports.
+ * @var HASH_BACKEND_MURMUR - scalar MurmurHash2, runs anywhere.
+ * @var HASH_BACKEND_CRC32C - SSE4.2 crc32 instruction on three interleaved streams.
+ * @var HASH_BACKEND_AVX2 - multiply-accumulate rounds on 4 vectors of 4 64 bit lanes, 128 bytes per step,
+ *                          folded with CRC32C, needs SSE4.2 too.
+ */
+enum HashBackend
+{
+    HASH_BACKEND_AUTO,
+    HASH_BACKEND_MURMUR,
+    HASH_BACKEND_CRC32C,
+    HASH_BACKEND_AVX2,
+};
+
+inline const char* HASH_BACKEND_NAMES[] =
+{
+    "AUTO", "MURMUR", "CRC32C", "AVX2",
+};
+
+/**
+ * @brief Hashes len bytes with the current backend, @see SetHashBackend.
+ * 
+ * The first call picks @see HASH_BACKEND_AUTO unless a backend was set.
+ * Different backends give different hashes, use @see CalculatePortableHash
+ * for hashes that are stored or compared between processes.
+ * 
+ * @param key - the bytes.
+ * @param len - number of bytes.
+ * @param seed - initial value.
+ * @return hash.
+ */
 unsigned int CalculateHash(const void *key, size_t len, unsigned int seed);
 
+/**
+ * @brief MurmurHash2 of len bytes regardless of the backend.
+ * 
+ * @param key - the bytes.
+ * @param len - number of bytes.
+ * @param seed - initial value.
+ * @return hash.
+ */
+unsigned int CalculatePortableHash(const void *key, size_t len, unsigned int seed);
+
+/**
+ * @brief Hashes len bytes with the given backend regardless of the current one.
+ * 
+ * @param backend - the backend, not @see HASH_BACKEND_AUTO.
+ * @param key - the bytes.
+ * @param len - number of bytes.
+ * @param seed - initial value.
+ * @return hash, 0 if the CPU does not support the backend.
+ */
+unsigned int CalculateBackendHash(enum HashBackend backend, const void *key, size_t len, unsigned int seed);
+
+/**
+ * @brief Tells if the CPU supports a backend, @see HASH_BACKEND_AUTO is never supported.
+ * 
+ * @param backend - the backend.
+ * @return whether it can be used.
+ */
+bool IsHashBackendSupported(enum HashBackend backend);
+
+/**
+ * @brief Sets the backend of @see CalculateHash.
+ * 
+ * Hashes stored so far are invalidated, so it must be called before any hashed stack is created.
+ * 
+ * @param backend - the backend.
+ * @return ERROR_BAD_VALUE if the CPU does not support it.
+ */
+enum ErrorCode SetHashBackend(enum HashBackend backend);
+
+/**
+ * @brief Returns the backend of @see CalculateHash, picks it if it was not picked yet.
+ * 
+ * @return backend.
+ */
+enum HashBackend GetHashBackend();
+
+/**
+ * @brief Turns on or off counting of the cycles spent in @see CalculateHash.
+ * 
+ * Every call is timed with rdtsc, which costs more than hashing a single slot,
+ * so it is meant for benchmarks. Turning it on resets the counter of the calling thread.
+ * 
+ * @param on - whether to count.
+ */
+void SetHashProfiling(bool on);
+
+/**
+ * @brief Returns the TSC cycles the calling thread spent in @see CalculateHash, @see SetHashProfiling.
+ * 
+ * @return cycles.
+ */
+uint64_t GetHashCycles();
+
 #endif
\ No newline at end of file
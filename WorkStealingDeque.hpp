@@ -0,0 +1,430 @@
+//! @file
+
+#ifndef WORK_STEALING_DEQUE_HPP
+#define WORK_STEALING_DEQUE_HPP
+
+#include <stdlib.h>
+#include "ConcurrentStack.hpp"
+
+/**
+ * @brief Chase-Lev work-stealing deque of T.
+ *
+ * The owner thread pushes and pops at the bottom like a @see Stack,
+ * with plain loads and stores on the fast path; only popping the last element
+ * needs a CAS. Any other thread may steal from the top with @see Steal.
+ *
+ * The elements live in a circular buffer with the @see Stack layout
+ * (canary, data, canary) that grows by @see _getNewCapacity. Thieves may
+ * still read a replaced buffer, so it is freed through hazard pointers.
+ *
+ * Thieves copy elements before they know the steal succeeded, so T must be @see STACK_TRIVIAL.
+ * Protection is at most @see STACK_PROTECTION_CANARY.
+*/
+template <typename T>
+struct WorkStealingDeque;
+
+/**
+ * @brief Struct that @see WorkStealingDequeInit returns. If error is not 0, then value = NULL.
+ *
+ * @var WorkStealingDequeResult::value - pointer to the deque.
+ * @var WorkStealingDequeResult::error - error message @see ErrorCode.
+*/
+template <typename T>
+struct WorkStealingDequeResult
+{
+    WorkStealingDeque<T>* value;
+    ErrorCode error;
+};
+
+/**
+ * @brief Initializes a work-stealing deque, the calling thread becomes its owner.
+ *
+ * @param [in] type - element type.
+ * @param [in] protection - optional @see StackProtection, @see DEFAULT_PROTECTION if omitted.
+ *
+ * @return WorkStealingDequeResult<type>.
+*/
+#define WorkStealingDequeInit(type, ...)                                                 \
+({                                                                                       \
+    SourceCodePosition _owner = {__FILE__, __LINE__, __func__};                          \
+    _workStealingDequeInit<type>(&_owner, ##__VA_ARGS__);                                \
+})
+
+template <typename T>
+WorkStealingDequeResult<T> _workStealingDequeInit(SourceCodePosition* owner,
+                                                  StackProtection protection = DEFAULT_PROTECTION);
+
+/**
+ * @brief Destroys the deque.
+ *
+ * @note No other thread may use the deque at this point.
+ *
+ * @param [in] deque - the deque to destroy.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode StackDestructor(WorkStealingDeque<T>* deque);
+
+/**
+ * @brief Checks the deque and buffer canaries.
+ *
+ * @param [in] deque - the deque to check.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode CheckStackIntegrity(WorkStealingDeque<T>* deque);
+
+/**
+ * @brief Pushes an element to the bottom, owner only.
+ *
+ * @param [in] deque - the deque.
+ * @param [in] value - the value.
+ *
+ * @return @see ErrorCode.
+*/
+template <typename T>
+ErrorCode Push(WorkStealingDeque<T>* deque, T value);
+
+/**
+ * @brief Pops an element from the bottom, owner only.
+ *
+ * @param [in] deque - the deque.
+ *
+ * @return @see StackElementResult, ERROR_INDEX_OUT_OF_BOUNDS if the deque is empty.
+*/
+template <typename T>
+StackElementResult<T> Pop(WorkStealingDeque<T>* deque);
+
+/**
+ * @brief Steals an element from the top, any thread.
+ *
+ * @param [in] deque - the deque.
+ *
+ * @return @see StackElementResult, ERROR_INDEX_OUT_OF_BOUNDS if the deque is empty.
+*/
+template <typename T>
+StackElementResult<T> Steal(WorkStealingDeque<T>* deque);
+
+/**
+ * @brief Circular buffer, replaced as a whole when the deque grows.
+*/
+template <typename T>
+struct _DequeBuffer
+{
+    size_t capacity;
+    size_t realDataSize;
+    T* data;
+};
+
+template <typename T>
+struct WorkStealingDeque
+{
+    #ifdef CANARY_PROTECTION
+    canary_t leftCanary;
+    #endif
+
+    SourceCodePosition origin;
+    StackProtection protection;
+
+    _DequeBuffer<T>* buffer;
+
+    alignas(64) int64_t top;
+
+    alignas(64) int64_t bottom;
+
+    #ifdef CANARY_PROTECTION
+    alignas(64) canary_t rightCanary;
+    #endif
+};
+
+template <typename T>
+static _DequeBuffer<T>* _dequeBufferCreate(size_t capacity);
+
+template <typename T>
+static void _dequeBufferFree(void* buffer);
+
+template <typename T>
+static ErrorCode _dequeGrow(WorkStealingDeque<T>* deque, int64_t top, int64_t bottom);
+
+template <typename T>
+static inline T _dequeLoadSlot(const T* slot);
+
+template <typename T>
+static inline void _dequeStoreSlot(T* slot, const T& value);
+
+template <typename T>
+WorkStealingDequeResult<T> _workStealingDequeInit(SourceCodePosition* origin, StackProtection protection)
+{
+    static_assert(STACK_TRIVIAL<T>, "Stolen elements are copied speculatively, T must be trivially copyable");
+
+    void* memory = aligned_alloc(alignof(WorkStealingDeque<T>), sizeof(WorkStealingDeque<T>));
+
+    if (!memory)
+        return {NULL, ERROR_NO_MEMORY};
+
+    WorkStealingDeque<T>* deque = (WorkStealingDeque<T>*)memory;
+
+    *deque = {};
+
+    deque->origin = *origin;
+    deque->protection = min(protection, STACK_PROTECTION_CANARY);
+    deque->buffer = _dequeBufferCreate<T>(DEFAULT_CAPACITY);
+
+    #ifdef CANARY_PROTECTION
+    deque->leftCanary = _CANARY;
+    deque->rightCanary = _CANARY;
+    #endif
+
+    if (!deque->buffer)
+    {
+        free(deque);
+        return {NULL, ERROR_NO_MEMORY};
+    }
+
+    return {deque, EVERYTHING_FINE};
+}
+
+template <typename T>
+ErrorCode StackDestructor(WorkStealingDeque<T>* deque)
+{
+    ErrorCode error = CheckStackIntegrity(deque);
+    RETURN_ERROR(error);
+
+    _dequeBufferFree<T>(deque->buffer);
+
+    deque->buffer = NULL;
+    deque->origin = {};
+    deque->top = (int64_t)SIZET_POISON;
+    deque->bottom = (int64_t)SIZET_POISON;
+
+    #ifdef CANARY_PROTECTION
+    deque->leftCanary = SIZET_POISON;
+    deque->rightCanary = SIZET_POISON;
+    #endif
+
+    free(deque);
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode CheckStackIntegrity(WorkStealingDeque<T>* deque)
+{
+    MyAssertSoft(deque, ERROR_NULLPTR);
+
+    if (!deque->buffer)
+        return ERROR_NO_MEMORY;
+
+    #ifdef CANARY_PROTECTION
+    if (deque->protection >= STACK_PROTECTION_CANARY)
+    {
+        _DequeBuffer<T>* buffer = deque->buffer;
+
+        if (deque->leftCanary != _CANARY ||
+            deque->rightCanary != _CANARY ||
+            *_getLeftDataCanaryPtr(buffer->data) != _CANARY ||
+            *_getRightDataCanaryPtr(buffer->data, buffer->realDataSize) != _CANARY)
+            return ERROR_DEAD_CANARY;
+    }
+    #endif
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+ErrorCode Push(WorkStealingDeque<T>* deque, T value)
+{
+    MyAssertSoft(deque, ERROR_NULLPTR);
+
+    if (deque->protection != STACK_PROTECTION_NONE)
+        RETURN_ERROR(CheckStackIntegrity(deque));
+
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    int64_t top    = __atomic_load_n(&deque->top,    __ATOMIC_ACQUIRE);
+
+    _DequeBuffer<T>* buffer = deque->buffer;
+
+    if ((size_t)(bottom - top) == buffer->capacity)
+    {
+        RETURN_ERROR(_dequeGrow(deque, top, bottom));
+        buffer = deque->buffer;
+    }
+
+    _dequeStoreSlot(&buffer->data[(size_t)bottom % buffer->capacity], value);
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+
+    return EVERYTHING_FINE;
+}
+
+template <typename T>
+StackElementResult<T> Pop(WorkStealingDeque<T>* deque)
+{
+    MyAssertSoftResult(deque, _getPoison<T>(), ERROR_NULLPTR);
+
+    if (deque->protection != STACK_PROTECTION_NONE)
+    {
+        ErrorCode error = CheckStackIntegrity(deque);
+
+        if (error)
+            return {_getPoison<T>(), error};
+    }
+
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    _DequeBuffer<T>* buffer = deque->buffer;
+
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (bottom < top)
+    {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return {_getPoison<T>(), ERROR_INDEX_OUT_OF_BOUNDS};
+    }
+
+    T value = buffer->data[(size_t)bottom % buffer->capacity];
+
+    if (bottom > top)
+        return {value, EVERYTHING_FINE};
+
+    // The last element, race thieves for it
+    bool won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+
+    if (!won)
+        return {_getPoison<T>(), ERROR_INDEX_OUT_OF_BOUNDS};
+
+    return {value, EVERYTHING_FINE};
+}
+
+template <typename T>
+StackElementResult<T> Steal(WorkStealingDeque<T>* deque)
+{
+    MyAssertSoftResult(deque, _getPoison<T>(), ERROR_NULLPTR);
+
+    while (true)
+    {
+        int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+        if (bottom <= top)
+            return {_getPoison<T>(), ERROR_INDEX_OUT_OF_BOUNDS};
+
+        _DequeBuffer<T>* buffer = (_DequeBuffer<T>*)_hazardProtect((void**)&deque->buffer);
+
+        // May race with the owner reusing the slot, the CAS below throws such a copy away
+        T value = _dequeLoadSlot(&buffer->data[(size_t)top % buffer->capacity]);
+
+        _hazardClear();
+
+        if (__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            return {value, EVERYTHING_FINE};
+    }
+}
+
+template <typename T>
+static _DequeBuffer<T>* _dequeBufferCreate(size_t capacity)
+{
+    _DequeBuffer<T>* buffer = (_DequeBuffer<T>*)calloc(1, sizeof(_DequeBuffer<T>));
+
+    if (!buffer)
+        return NULL;
+
+    size_t realDataSize = _getRealDataSize<T>(capacity);
+    char* memory = (char*)calloc(realDataSize, 1);
+
+    if (!memory)
+    {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer->capacity = capacity;
+    buffer->realDataSize = realDataSize;
+    buffer->data = (T*)(memory + _getDataOffset<T>());
+
+    #ifdef CANARY_PROTECTION
+    *_getLeftDataCanaryPtr(buffer->data) = _CANARY;
+    *_getRightDataCanaryPtr(buffer->data, realDataSize) = _CANARY;
+    #endif
+
+    _poisonSlots(buffer->data, 0, capacity);
+
+    return buffer;
+}
+
+template <typename T>
+static void _dequeBufferFree(void* bufferPtr)
+{
+    _DequeBuffer<T>* buffer = (_DequeBuffer<T>*)bufferPtr;
+
+    free((char*)buffer->data - _getDataOffset<T>());
+    free(buffer);
+}
+
+/**
+ * @brief Relaxed atomic copy of a slot a thief reads while the owner may write it.
+ *
+ * Elements wider than a lock-free atomic are copied a byte at a time, a torn copy
+ * is thrown away by the CAS of @see Steal like any other stale one.
+*/
+template <typename T>
+static inline T _dequeLoadSlot(const T* slot)
+{
+    T value;
+
+    if constexpr (__atomic_always_lock_free(sizeof(T), 0))
+        __atomic_load(slot, &value, __ATOMIC_RELAXED);
+    else
+        for (size_t i = 0; i < sizeof(T); i++)
+            __atomic_load((const unsigned char*)slot + i, (unsigned char*)&value + i, __ATOMIC_RELAXED);
+
+    return value;
+}
+
+/**
+ * @brief Relaxed atomic write of a slot, the pair of @see _dequeLoadSlot.
+*/
+template <typename T>
+static inline void _dequeStoreSlot(T* slot, const T& value)
+{
+    if constexpr (__atomic_always_lock_free(sizeof(T), 0))
+        __atomic_store(slot, (T*)&value, __ATOMIC_RELAXED);
+    else
+        for (size_t i = 0; i < sizeof(T); i++)
+            __atomic_store((unsigned char*)slot + i, (unsigned char*)&value + i, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Moves [top, bottom) to a bigger buffer, the old one is retired.
+*/
+template <typename T>
+static ErrorCode _dequeGrow(WorkStealingDeque<T>* deque, int64_t top, int64_t bottom)
+{
+    _DequeBuffer<T>* oldBuffer = deque->buffer;
+
+    size_t newCapacity = _getNewCapacity((size_t)(bottom - top), oldBuffer->capacity, &DEFAULT_GROWTH_POLICY);
+
+    _DequeBuffer<T>* newBuffer = _dequeBufferCreate<T>(newCapacity);
+
+    if (!newBuffer)
+        return ERROR_NO_MEMORY;
+
+    for (int64_t i = top; i < bottom; i++)
+        newBuffer->data[(size_t)i % newCapacity] = oldBuffer->data[(size_t)i % oldBuffer->capacity];
+
+    __atomic_store_n(&deque->buffer, newBuffer, __ATOMIC_RELEASE);
+
+    _hazardRetire(oldBuffer, _dequeBufferFree<T>);
+
+    return EVERYTHING_FINE;
+}
+
+#endif
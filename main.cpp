@@ -6,7 +6,7 @@
 
 int main()
 {
-    StackResult tempStack = StackInit();
+    StackResult<int> tempStack = StackInit(int);
 
     if (tempStack.error != EVERYTHING_FINE)
     {
@@ -14,7 +14,7 @@ int main()
         return tempStack.error;
 
     }
-    Stack* stack = tempStack.value;
+    Stack<int>* stack = tempStack.value;
     for (int i = 0; i < 9; i++)
     {
         ErrorCode error = Push(stack, i);
@@ -28,7 +28,7 @@ int main()
 
     for (int i = 0; i < 9; i++)
     {
-        StackElementResult el = Pop(stack);
+        StackElementResult<int> el = Pop(stack);
         if (el.error != EVERYTHING_FINE)
         {
             fprintf(stderr, "ERROR\n");